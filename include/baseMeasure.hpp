@@ -21,6 +21,69 @@ using namespace std;
 using namespace arma;
 
 
+/*
+ * Sufficient statistics of a set of (weighted) observations under a base
+ * measure as obtained from BaseMeasure::newStats(). Observations can be 
+ * added, removed and merged without keeping copies of the data around.
+ * templated on the unit
+ */
+template<class U>
+class SuffStats
+{
+public:
+  SuffStats()
+    : mN(0.0)
+  {};
+
+  virtual ~SuffStats()
+  {};
+
+  virtual SuffStats<U>* getCopy() const
+  {
+    cerr<<"SuffStats:: getCopy()"<<endl;
+    exit(0);
+    return NULL;
+  };
+
+  // add observation x with weight w
+  virtual void add(const Col<U>& x, double w=1.0)
+  {
+    cerr<<"SuffStats:: add()"<<endl;
+    exit(0);
+  };
+
+  void remove(const Col<U>& x, double w=1.0)
+  {
+    add(x,-w);
+  };
+
+  // add all columns of X weighted by w
+  virtual void addBatch(const Mat<U>& X, const Col<double>& w)
+  {
+    for (uint32_t i=0; i<X.n_cols; ++i)
+      add(X.col(i),w(i));
+  };
+
+  // add the statistics of ss (of the same kind) weighted by w; w=-1 removes them
+  virtual void merge(const SuffStats<U>& ss, double w=1.0)
+  {
+    cerr<<"SuffStats:: merge()"<<endl;
+    exit(0);
+  };
+
+  virtual void zero()
+  {
+    mN = 0.0;
+  };
+
+  double count() const
+  {
+    return mN;
+  };
+
+  double mN; // (weighted) number of observations
+};
+
 /*
  * templated on the unit
  */
@@ -28,6 +91,8 @@ template<class U>
 class BaseMeasure
 {
 public:
+  typedef BaseMeasure<U> ModeType; // concrete type of the distributions returned by mode()
+
   BaseMeasure()
     : mRowDim(0)
   {
@@ -53,6 +118,21 @@ public:
     exit(0);
     return 0.0;
   };
+  // predictive probability of x_q given the data summarized in ss
+  virtual double predictiveProb(const Col<U>& x_q, const SuffStats<U>& ss) const
+  {
+    cerr<<"BaseMeasure:: Something gone wrong with virtual functions"<<endl;
+    exit(0);
+    return 0.0;
+  };
+
+  // empty sufficient statistics that fit this base measure
+  virtual SuffStats<U>* newStats() const
+  {
+    cerr<<"BaseMeasure:: newStats()"<<endl;
+    exit(0);
+    return NULL;
+  };
 
   virtual BaseMeasure<U>* getCopy() const
   { 
@@ -71,6 +151,40 @@ public:
   {
     return mRowDim;
   };
+
+  /*
+   * In-place arithmetic on the parameters (as laid out by asRow()) for
+   * the blending and accumulation of the SVI updates without going 
+   * through asRow()/fromRow():
+   * this = b*this + a*x  (x has to be of the same kind as this)
+   */
+  virtual void axpy(double a, const BaseMeasure<U>& x, double b=1.0)
+  {
+    cerr<<"BaseMeasure:: axpy()"<<endl;
+    exit(0);
+  };
+
+  // this = s*this
+  virtual void scale(double s)
+  {
+    cerr<<"BaseMeasure:: scale()"<<endl;
+    exit(0);
+  };
+
+  // sets all parameters to zero (e.g. to start an accumulation with axpy())
+  virtual void zero()
+  {
+    cerr<<"BaseMeasure:: zero()"<<endl;
+    exit(0);
+  };
+
+  /*
+   * axpy(), scale() and zero() may leave quantities that are cached for the
+   * evaluation out of date; they are refreshed on the first evaluation. 
+   * Call refresh() before the measure is evaluated by several threads.
+   */
+  virtual void refresh() const
+  { };
   
   virtual void fromRow(const Row<double>& r)
   {
@@ -88,21 +202,66 @@ public:
     cerr<<"BaseMeasure:: Elog()"<<endl;
     exit(0);};
 
+  /*
+   * Elog() of all columns of X in one call; base measures should override
+   * it with a vectorized version
+   * @param eLog 1 x X.n_cols
+   */
+  virtual void ElogBatch(const Mat<U>& X, Row<double>& eLog) const
+  {
+    eLog.set_size(X.n_cols);
+    for (uint32_t i=0; i<X.n_cols; ++i)
+      eLog(i) = Elog(X.col(i));
+  };
+
+  /*
+   * E[log p(x)] for all atoms of a base measure with finite support 
+   * (e.g. all words of the dictionary for Dir). 
+   * @return false if the support is not finite (e.g. NIW)
+   */
+  virtual bool ElogTable(Row<double>& eLog) const
+  {
+    return false;
+  };
+
   virtual void posteriorHDP_var(const Col<double>& zeta, const Mat<double>& phi, uint32_t D, const Mat<U>& x)
   {
     cerr<<"BaseMeasure:: posteriorHDP_var()"<<endl;
     exit(0);};
 
+  /*
+   * posteriorHDP_var() from the statistics of a doc whose points were added 
+   * with the weights phi*zeta
+   */
+  virtual void posteriorHDP_var(const SuffStats<U>& ss, uint32_t D)
+  {
+    cerr<<"BaseMeasure:: posteriorHDP_var()"<<endl;
+    exit(0);};
+
   virtual void posterior(const Mat<U>& x)
   {
     cerr<<"BaseMeasure:: posterior()"<<endl;
     exit(0);};
 
+  virtual void posterior(const SuffStats<U>& ss)
+  {
+    cerr<<"BaseMeasure:: posterior()"<<endl;
+    exit(0);};
+
   virtual double logP(const Col<U>& x) const
   { 
     cerr<<"BaseMeasure:: logP()"<<endl;
     exit(0);}
 
+  /*
+   * number of observations each column of x stands for; 
+   * one per column unless the base measure supports a compressed representation
+   */
+  virtual void counts(const Mat<U>& x, Col<double>& w) const
+  {
+    w.ones(x.n_cols);
+  };
+
 protected:
   uint32_t mRowDim;
 
@@ -216,9 +375,67 @@ class Gauss : public BaseMeasure<double>
 private:
 };
 
+/*
+ * word counts of a Dir; columns of a doc are either single words or 
+ * (word, count) pairs of the bag-of-words form
+ */
+class DirStats : public SuffStats<uint32_t>
+{
+public:
+  DirStats(uint32_t Nw)
+  {
+    mCounts.zeros(Nw);
+  };
+
+  virtual DirStats* getCopy() const
+  {
+    return new DirStats(*this);
+  };
+
+  virtual void add(const Col<uint32_t>& x, double w=1.0)
+  {
+    double c = x.n_elem>1 ? w*double(x(1)) : w;
+    mCounts(x(0)) += c;
+    mN += c;
+  };
+
+  virtual void addBatch(const Mat<uint32_t>& X, const Col<double>& w)
+  {
+    for (uint32_t i=0; i<X.n_cols; ++i)
+    {
+      double c = X.n_rows>1 ? w(i)*double(X(1,i)) : w(i);
+      mCounts(X(0,i)) += c;
+      mN += c;
+    }
+  };
+
+  virtual void merge(const SuffStats<uint32_t>& ss, double w=1.0)
+  {
+    const DirStats& o = static_cast<const DirStats&>(ss);
+    mCounts += w*o.mCounts;
+    mN += w*o.mN;
+  };
+
+  virtual void zero()
+  {
+    mCounts.zeros();
+    mN = 0.0;
+  };
+
+  Row<double> mCounts; // counts of each word
+};
+
+/*
+ * Dirichlet distribution over the words of a dictionary. 
+ * Documents can either be given as a 1xN list of words or in the compressed
+ * bag-of-words form as a 2xNu matrix with the unique word ids in the first 
+ * row and the number of their occurences in the second row (see bagOfWords()).
+ */
 class Dir : public BaseMeasure<uint32_t>
 {
 public:
+  typedef Mult ModeType;
+
   Dir(const Row<double>& alphas)
   : mAlphas(alphas), mAlpha0(sum(alphas))
   {
@@ -250,6 +467,27 @@ public:
     mAlpha0 = sum(r);
   };
 
+  virtual void axpy(double a, const BaseMeasure<uint32_t>& x, double b=1.0)
+  {
+    const Dir& dir = static_cast<const Dir&>(x);
+    if (b != 1.0)
+      mAlphas *= b;
+    mAlphas += a*dir.mAlphas;
+    mAlpha0 = b*mAlpha0 + a*dir.mAlpha0;
+  };
+
+  virtual void scale(double s)
+  {
+    mAlphas *= s;
+    mAlpha0 *= s;
+  };
+
+  virtual void zero()
+  {
+    mAlphas.zeros();
+    mAlpha0 = 0.0;
+  };
+
   virtual BaseMeasure<uint32_t>* mode() const
 //  virtual BaseMeasure<uint32_t> mode() const
   {
@@ -264,38 +502,99 @@ public:
     return digamma(mAlphas(x(0))) - digamma(mAlpha0);
   };
 
+  virtual void ElogBatch(const Mat<uint32_t>& X, Row<double>& eLog) const
+  {
+    double digam_alpha0 = digamma(mAlpha0);
+    eLog.set_size(X.n_cols);
+    for (uint32_t i=0; i<X.n_cols; ++i)
+      eLog(i) = digamma(mAlphas(X(0,i))) - digam_alpha0;
+  };
+
+  virtual bool ElogTable(Row<double>& eLog) const
+  {
+    double digam_alpha0 = digamma(mAlpha0);
+    eLog.set_size(mAlphas.n_elem);
+    for (uint32_t w=0; w<mAlphas.n_elem; ++w)
+      eLog(w) = digamma(mAlphas(w)) - digam_alpha0;
+    return true;
+  };
+
   /*
    * update parameters using observations x to form posterior for stochastic variational HDP
    */
   virtual void posteriorHDP_var(const Col<double>& zeta, const Mat<double>& phi, uint32_t D, const Mat<uint32_t>& x)
-  { 
-
-    uint32_t N = x.n_cols;
-    uint32_t T = zeta.n_rows;
-    uint32_t Nw = mAlphas.n_elem;
-
-    Row<double> lambda(Nw);
-    lambda.zeros();
-    for (uint32_t i=0; i<T; ++i) 
+  { // only the words of x are touched
+    Col<double> w = phi*zeta;
+    Col<double> c;
+    counts(x,c);
+    for (uint32_t i=0; i<x.n_cols; ++i)
     {
-      Row<double> _lambda(Nw); 
-      _lambda.zeros();
-      for (uint32_t n=0; n<N; ++n){
-        _lambda(x(n)) += phi(n,i);
-      }
-      lambda += zeta(i) * _lambda;
+      double a = D*w(i)*c(i);
+      mAlphas(x(0,i)) += a;
+      mAlpha0 += a;
     }
-    mAlphas += D*lambda;
-    //cout<<"lambda-nu="<<d_lambda[k].t()<<endl;
-    //cout<<"lambda="<<d_lambda[k].t()<<endl;
+  };
+
+  virtual void posteriorHDP_var(const SuffStats<uint32_t>& ss, uint32_t D)
+  {
+    mAlphas += D*static_cast<const DirStats&>(ss).mCounts;
+    mAlpha0 += D*ss.mN;
   };
 
   virtual void posterior(const Mat<uint32_t>& x)
   { 
     uint32_t N = x.n_cols;
+    Col<double> w; 
+    counts(x,w);
     for (uint32_t i=0; i< N; ++i)
-      mAlphas[x[i]] ++;
-    mAlpha0= sum(mAlphas);
+    {
+      mAlphas[x(0,i)] += w(i);
+      mAlpha0 += w(i);
+    }
+  };
+
+  virtual void posterior(const SuffStats<uint32_t>& ss)
+  {
+    mAlphas += static_cast<const DirStats&>(ss).mCounts;
+    mAlpha0 += ss.mN;
+  };
+
+  virtual DirStats* newStats() const
+  {
+    return new DirStats(mAlphas.n_elem);
+  };
+
+  virtual void counts(const Mat<uint32_t>& x, Col<double>& w) const
+  {
+    if (x.n_rows > 1)
+      w = conv_to<Col<double> >::from(x.row(1).t()); // bag-of-words form
+    else
+      w.ones(x.n_cols);
+  };
+
+  /*
+   * compress a 1xN list of words into the 2xNu bag-of-words form
+   * (unique word ids in the first row; their counts in the second)
+   */
+  static Mat<uint32_t> bagOfWords(const Mat<uint32_t>& x)
+  {
+    if (x.n_rows > 1) 
+      return x; // already compressed
+    Row<uint32_t> x_s = x.row(0);
+    x_s = sort(x_s);
+    Mat<uint32_t> bow(2,x_s.n_elem);
+    uint32_t Nu=0;
+    for (uint32_t n=0; n<x_s.n_elem; ++n)
+      if (Nu>0 && bow(0,Nu-1) == x_s(n))
+      {
+        bow(1,Nu-1) ++;
+      }else{
+        bow(0,Nu) = x_s(n);
+        bow(1,Nu) = 1;
+        ++Nu;
+      }
+    bow.resize(2,Nu);
+    return bow;
   };
 
   /*
@@ -322,6 +621,13 @@ public:
     return log(mAlphas(k)/mAlpha0);
   };
 
+  double predictiveProb(const Col<uint32_t>& x_q, const SuffStats<uint32_t>& ss) const
+  {
+    const DirStats& st = static_cast<const DirStats&>(ss);
+    const uint32_t k=x_q(0);
+    return log((st.mCounts(k) + mAlphas(k))/(st.mN + mAlpha0));
+  };
+
 
   Row<double> mAlphas;
   double mAlpha0;
@@ -331,9 +637,87 @@ private:
 
 
 
+/*
+ * number of points, mean and centered scatter sum (x-mean)(x-mean)^T of 
+ * the points of a NIW. They are updated as in Welford's algorithm so that 
+ * the scatter does not cancel for points far from the origin.
+ */
+class NIWStats : public SuffStats<double>
+{
+public:
+  NIWStats(uint32_t d)
+  {
+    mMean.zeros(d);
+    mScatter.zeros(d,d);
+  };
+
+  virtual NIWStats* getCopy() const
+  {
+    return new NIWStats(*this);
+  };
+
+  virtual void add(const Col<double>& x, double w=1.0)
+  {
+    double n = mN + w;
+    if (n <= 0.0)
+    { // the last point was removed
+      NIWStats::zero();
+      return;
+    }
+    colvec dx = x - mMean;
+    mMean += (w/n)*dx;
+    mScatter += (w*mN/n)*dx*dx.t();
+    mN = n;
+  };
+
+  virtual void addBatch(const Mat<double>& X, const Col<double>& w)
+  {
+    double n = sum(w);
+    if (n == 0.0) return;
+    colvec mean = X*w/n;
+    Mat<double> Xc = X;
+    Xc.each_col() -= mean;
+    combine(n, mean, Xc*diagmat(w)*Xc.t());
+  };
+
+  virtual void merge(const SuffStats<double>& ss, double w=1.0)
+  {
+    const NIWStats& o = static_cast<const NIWStats&>(ss);
+    combine(w*o.mN, o.mMean, w*o.mScatter);
+  };
+
+  virtual void zero()
+  {
+    mN = 0.0;
+    mMean.zeros();
+    mScatter.zeros();
+  };
+
+  colvec mMean;
+  mat mScatter;
+
+protected:
+  // adds n points with mean and centered scatter S
+  void combine(double n, const colvec& mean, const mat& S)
+  {
+    double nNew = mN + n;
+    if (nNew <= 0.0)
+    {
+      NIWStats::zero();
+      return;
+    }
+    colvec dx = mean - mMean;
+    mMean += (n/nNew)*dx;
+    mScatter += S + (mN*n/nNew)*dx*dx.t();
+    mN = nNew;
+  };
+};
+
 class NIW : public BaseMeasure<double>
 {
 public:
+  typedef Gauss ModeType;
+
   // make a copy of vtheta and Delta (that should only be a copy of the header anyway
   NIW(colvec vtheta, double kappa, mat Delta, double nu)
   : mVtheta(vtheta), mKappa(kappa), mDelta(Delta), mNu(nu)
@@ -342,10 +726,13 @@ public:
     
     mRowDim = mVtheta.n_elem;
     mRowDim = mRowDim*mRowDim + mRowDim +2;
+    updateCache();
   };
 
   NIW(const NIW& niw)
-  : mVtheta(niw.mVtheta), mKappa(niw.mKappa), mDelta(niw.mDelta), mNu(niw.mNu)
+  : mVtheta(niw.mVtheta), mKappa(niw.mKappa), mDelta(niw.mDelta), mNu(niw.mNu),
+    mCholOk(niw.mCholOk), mL(niw.mL), mLogDetDelta(niw.mLogDetDelta),
+    mElogConst(niw.mElogConst), mCacheDirty(niw.mCacheDirty)
   {
     mRowDim = mVtheta.n_elem;
     mRowDim = mRowDim*mRowDim + mRowDim +2;
@@ -388,6 +775,45 @@ public:
       mVtheta(i) = row(d*d+i);
     mNu = row(d*d+d);
     mKappa = row(d*d+d+1);
+    updateCache();
+  };
+
+  virtual void axpy(double a, const BaseMeasure<double>& x, double b=1.0)
+  {
+    const NIW& niw = static_cast<const NIW&>(x);
+    if (b != 1.0)
+    {
+      mDelta *= b;
+      mVtheta *= b;
+    }
+    mDelta += a*niw.mDelta;
+    mVtheta += a*niw.mVtheta;
+    mNu = b*mNu + a*niw.mNu;
+    mKappa = b*mKappa + a*niw.mKappa;
+    mCacheDirty = true;
+  };
+
+  virtual void scale(double s)
+  {
+    mDelta *= s;
+    mVtheta *= s;
+    mNu *= s;
+    mKappa *= s;
+    mCacheDirty = true;
+  };
+
+  virtual void zero()
+  {
+    mDelta.zeros();
+    mVtheta.zeros();
+    mNu = 0.0;
+    mKappa = 0.0;
+    mCacheDirty = true;
+  };
+
+  virtual void refresh() const
+  {
+    if (mCacheDirty) updateCache();
   };
 
   virtual BaseMeasure<double>* mode() const
@@ -422,9 +848,10 @@ public:
 //    cout<<"vtheta: "<<mVtheta;
 //    cout<<"delta: "<<mDelta;
 //    cout<<"kappa: "<<mKappa<<" nu="<<mNu<<endl;
-    double sq = as_scalar((x+mVtheta).t()*solve(mDelta,x+mVtheta));
+    refresh();
+    double sq = mahalanobis(x+mVtheta);
 
-    double eLog= -0.5*d*log(datum::pi) -0.5*log(det(mDelta)) +0.5*digamma_mult(-0.5*mNu,uint32_t(d)) -0.5*(d/mKappa) -0.5*mNu*sq;
+    double eLog= mElogConst -0.5*mNu*sq;
 
     if(!is_finite(mVtheta)|| !is_finite(eLog))
     {
@@ -437,147 +864,116 @@ public:
     return eLog;
   };
 
-  virtual void posteriorHDP_var(const Col<double>& zeta, const Mat<double>& phi, uint32_t D, const Mat<double>& x)
+  // one triangular solve for all points of X 
+  virtual void ElogBatch(const Mat<double>& X, Row<double>& eLog) const
   {
-    uint32_t N = x.n_cols;
-    uint32_t T = zeta.n_rows;
-
-//    cout<<" -----------------"<<endl;
-//    cout<<"N="<<N<<" T="<<T<<endl;
-    double counts=0.0;
-    for (uint32_t i=0; i<T; ++i){
-//      cout<<"counts= "<<counts<<" zeta="<<zeta(i)<<" sumphi="<<sum(phi.col(i))<<endl;
-      counts += zeta(i)*sum(phi.col(i));
-    }
-    counts*=D;
-
-    Col<double> x_hat(x.n_rows);
-    x_hat.zeros();
-    for (uint32_t i=0; i<T; ++i){
-      Col<double> x_sum(x.n_rows);
-      x_sum.zeros();
-      for (uint32_t n=0; n<N; ++n){
-        x_sum += phi(n,i)*x.col(n);
-      }
-      x_hat += zeta(i) * x_sum;
-    }
-    x_hat *= D/counts;
-
-    Mat<double> S(mDelta);
-    S.zeros();
-    for (uint32_t i=0; i<T; ++i){
-      Mat<double> S_sum(mDelta);
-      S_sum.zeros();
-      for (uint32_t n=0; n<N; ++n){
-        S_sum += phi(n,i)*(x.col(n)-x_hat)*(x.col(n)-x_hat).t();
-      }
-      S += zeta(i) * S_sum;
-    }
-
-    // TODO: use zeta and Phi!!
-//    uint32_t n = x.n_cols;
-//    Col<double> x_hat=sum(x,1)/n;
-//    Mat<double> S(mDelta)
-//    S.zeros();
-//    for (uint32_t i=0; i<n; ++i)
-//      S += (x.col(i) - x_hat) * (x.col(i) - x_hat).t();
-
-      cout<<" -----------------"<<endl;
-      cout<<"vtheta(before): "<<mVtheta;
-//    cout<<"delta: "<<mDelta;
-//    cout<<"kappa: "<<mKappa<<" nu="<<mNu<<endl;
-//    cout<<"S="<<S;
-//    cout<<"x_hat="<<x_hat<< " sum/N="<<sum(x,1)/N;
-//    cout<<"counts="<<counts<<endl;
-    
-    mDelta += D*S + (mKappa*counts)/(mKappa+counts)*(x_hat - mVtheta)*(x_hat - mVtheta).t();
-    mVtheta = mKappa/(mKappa+counts)* mVtheta + counts/(mKappa+counts)*x_hat;
-    mKappa += counts;
-    mNu += counts;
-
+    refresh();
+    Mat<double> V = X;
+    V.each_col() += mVtheta;
+    Row<double> sq;
+    if (mCholOk)
+      sq = sum(square(solve(trimatl(mL),V)),0);
+    else
+      sq = sum(V % solve(mDelta,V),0);
+    eLog = mElogConst -0.5*mNu*sq;
 
-//    if(!is_finite(mVtheta) || accu(mDelta<0.0)>0)
+    if(!is_finite(mVtheta)|| !is_finite(eLog))
     {
-//      cout<<"zeta="<<zeta.t();
-//      cout<<"phi="<<phi;
-//      cout<<"N="<<N<<" T="<<T<<endl;
-//      cout<<"x="<<x;
-      cout<<"S="<<S;
-      cout<<"x_hat="<<x_hat<< " sum/N="<<sum(x,1)/N;
-      cout<<"counts="<<counts<<endl;
-      cout<<"-> vtheta: "<<mVtheta;
-      cout<<"-> delta: "<<mDelta;
-      cout<<"-> kappa: "<<mKappa<<" nu="<<mNu<<endl;
-//      exit(0);
+      cout<<"vtheta: "<<mVtheta;
+      cout<<"delta: "<<mDelta;
+      cout<<"kappa: "<<mKappa<<" nu="<<mNu<<endl;
+      exit(0);
     }
   };
 
-  virtual void posterior(const NIW& niw)
+  /*
+   * update parameters using observations x to form posterior for stochastic variational HDP
+   * in terms of the weighted sufficient statistics of x with the weights w = phi*zeta
+   */
+  virtual void posteriorHDP_var(const Col<double>& zeta, const Mat<double>& phi, uint32_t D, const Mat<double>& x)
   {
-    mDelta +=;  
+    Col<double> w = phi*zeta; // responsibility of this topic for each point
+    double w0 = sum(w);
+    if (w0 <= 0.0) return; 
+    double counts = D*w0;
+
+    Col<double> x_hat = x*w/w0;
+    Mat<double> xc = x;
+    xc.each_col() -= x_hat;
+    Mat<double> S = xc*diagmat(w)*xc.t(); // sum_n w_n (x_n-x_hat)(x_n-x_hat)^T
+    posterior(counts,x_hat,D*S);
   };
 
+  virtual void posteriorHDP_var(const SuffStats<double>& ss, uint32_t D)
+  {
+    const NIWStats& st = static_cast<const NIWStats&>(ss);
+    if (st.mN <= 0.0) return;
+    posterior(D*st.mN,st.mMean,D*st.mScatter);
+  };
 
-  virtual void posterior(const Mat<double>& x)
+  virtual void posterior(const SuffStats<double>& ss)
   {
-    uint32_t n = x.n_cols;
-    Col<double> x_hat=sum(x,1)/n;
-    Mat<double> S(mDelta);
-    S.zeros();
-    for (uint32_t i=0; i<n; ++i)
-      S += (x.col(i) - x_hat) * (x.col(i) - x_hat).t();
-    
-    mDelta = mDelta + S + (mKappa*n)/(mKappa+n)*(x_hat - mVtheta)*(x_hat - mVtheta).t();
-    mVtheta = mKappa/(mKappa+n)* mVtheta + n/(mKappa+n)*x_hat;
-    mKappa += x.n_cols;
-    mNu += x.n_cols;
+    posteriorHDP_var(ss,1);
   };
 
-  double predictiveProb(const Col<double>& x_q, const Mat<double>& x_given) const
+  // NIWPosteriorStats (see below) to evaluate the exact predictive cheaply
+  virtual NIWStats* newStats() const;
+
+  virtual void posterior(const Mat<double>& x)
   {
-    // compute posterior under x_given
-    // M0: number of data points in the cluster
-    // M1: sum over all data points in the cluster
-    // M2: x*x.T over all data points in the cluster
-    double M0=x_given.n_cols;
-    colvec M1=sum(x_given,1);
-    mat M2=x_given.t()*x_given;
-    double kappa = mKappa+M0;
-    double nu = mNu+M0;
-    colvec vtheta = (mKappa*mVtheta + M1)/kappa;
-    //    cout<<"vtheta="<<vtheta<<endl;
-    //    cout<<"mVtheta="<<mVtheta<<endl;
-    //    cout<<"M2="<<M2<<endl;
-    //    cout<<"mDelta="<<mDelta<<endl;
-    mat Delta = (mNu*mDelta + M2 + mKappa*(mVtheta*mVtheta.t()) - kappa*(vtheta*vtheta.t()))/nu;
-
-    // compute the likelihood of x_q under the posterior
-    // This can be approximated by using a moment matched gaussian
-    // to the multivariate student-t distribution which arises in
-    // when integrating over the parameters of the normal inverse
-    // wishart
-    mat C_matched=(((kappa+1.0)*nu)/(kappa*(nu-vtheta.n_rows-1.0)))*Delta;
-
-    return logGaus(x_q, vtheta, C_matched);
+    double n = x.n_cols;
+    Col<double> x_hat=sum(x,1)/n;
+    Mat<double> xc = x;
+    xc.each_col() -= x_hat;
+    posterior(n,x_hat,xc*xc.t());
   };
 
+  double predictiveProb(const Col<double>& x_q, const Mat<double>& x_given) const;
+
+  // ss has to be obtained from newStats()
+  double predictiveProb(const Col<double>& x_q, const SuffStats<double>& ss) const;
+
+  /*
+   * exact predictive of x_q under this NIW: a multivariate Student-t with 
+   * nu-d+1 degrees of freedom, mean vtheta and scale (kappa+1)/(kappa*(nu-d+1))*Delta
+   */
   double predictiveProb(const Col<double>& x_q) const
   {
-    // compute the likelihood of x_q under the posterior
-    // This can be approximated by using a moment matched gaussian
-    // to the multivariate student-t distribution which arises in
-    // when integrating over the parameters of the normal inverse
-    // wishart
-    mat C_matched=(((mKappa+1.0)*mNu)/(mKappa*(mNu-mVtheta.n_rows-1.0)))*mDelta;
+    refresh();
+    double d = mVtheta.n_elem;
+    if (mCholOk && mNu-d+1.0 > 0.0)
+      return logStudentT(x_q, mVtheta, mL, mKappa, mNu);
 
+    mat C_matched=((mKappa+1.0)/(mKappa*(mNu-d-1.0)))*mDelta; // moment matched Gaussian
     return logGaus(x_q, mVtheta, C_matched);
   };
 
+  /*
+   * log of the Student-t predictive of a NIW with mean vtheta, kappa, nu 
+   * and the lower Cholesky factor L of Delta; O(d^2)
+   */
+  static double logStudentT(const colvec& x, const colvec& vtheta, const mat& L, double kappa, double nu)
+  {
+    double d = vtheta.n_elem;
+    double dof = nu-d+1.0;
+    double c = (kappa+1.0)/(kappa*dof); // scale matrix = c*Delta
+    colvec z = solve(trimatl(L),x-vtheta);
+    return boost::math::lgamma(0.5*(dof+d)) - boost::math::lgamma(0.5*dof) 
+      -0.5*d*log(dof*datum::pi) -0.5*(d*log(c) + 2.0*sum(log(L.diag())))
+      -0.5*(dof+d)*log(1.0 + dot(z,z)/(c*dof));
+  };
+
   static double logGaus(const colvec& x, const colvec& mu, const mat& C)
   {
     //    cout<<"C"<<C<<endl;
     //    cout<<"mu"<<mu<<endl;
     //    cout<<"x"<<x<<endl;
+    mat L;
+    if (chol(L,C))
+    { // one factorization; L is upper triangular with L'L = C
+      colvec z = solve(trimatl(trans(L)),x-mu);
+      return -0.5*(double(C.n_rows)*1.8378770664093453 + 2.0*sum(log(L.diag())) + dot(z,z));
+    }
     double detC=det(C);
     if(!is_finite(detC))
       return 0.0;
@@ -588,12 +984,583 @@ public:
     return -0.5*(double(C.n_rows)*1.8378770664093453 + log(detC) + logXCX(0));
   };
 
+  // cached lower Cholesky factor of Delta (valid if cholOk()) and data independent part of Elog()
+  bool cholOk() const { refresh(); return mCholOk; };
+  const mat& cholDelta() const { refresh(); return mL; };
+  double elogConst() const { refresh(); return mElogConst; };
+
   colvec mVtheta;
   double mKappa;
   mat mDelta;
   double mNu;
-};
-
+
+protected:
+  /*
+   * Cached quantities derived from the parameters; refreshed by 
+   * updateCache() whenever fromRow() or a posterior update changes them so
+   * that evaluating a point only needs one triangular solve. The in-place
+   * arithmetic only marks them dirty since the SVI accumulators it is used
+   * on are never evaluated (see refresh()).
+   */
+  mutable bool mCholOk; // false if Delta is not positive definite
+  mutable mat mL; // lower Cholesky factor of Delta
+  mutable double mLogDetDelta; 
+  mutable double mElogConst; // data independent part of Elog()
+  mutable bool mCacheDirty;
+
+  void updateCache() const
+  {
+    mCacheDirty = false;
+    double d = mVtheta.n_elem;
+    if (mKappa <= 0.0)
+    { // zeroed accumulator (see zero()) -> nothing to evaluate
+      mCholOk = false;
+      return;
+    }
+    mCholOk = chol(mL,mDelta);
+    if (mCholOk)
+    {
+      mL = trans(mL); // chol gives the upper factor
+      mLogDetDelta = 2.0*sum(log(mL.diag()));
+    }else
+      mLogDetDelta = log(det(mDelta));
+    mElogConst = -0.5*d*log(datum::pi) -0.5*mLogDetDelta +0.5*digamma_mult(-0.5*mNu,uint32_t(d)) -0.5*(d/mKappa);
+  };
+
+  /*
+   * posterior update from counts points with mean x_hat and centered 
+   * scatter S
+   */
+  void posterior(double counts, const colvec& x_hat, const mat& S)
+  {
+    mDelta += S + (mKappa*counts)/(mKappa+counts)*(x_hat - mVtheta)*(x_hat - mVtheta).t();
+    mVtheta = mKappa/(mKappa+counts)* mVtheta + counts/(mKappa+counts)*x_hat;
+    mKappa += counts;
+    mNu += counts;
+    mCacheDirty = true; // e.g. the per doc SVI gradients are only accumulated
+  };
+
+  // v' Delta^-1 v
+  double mahalanobis(const colvec& v) const
+  {
+    refresh();
+    if (!mCholOk)
+      return as_scalar(v.t()*solve(mDelta,v));
+    colvec z = solve(trimatl(mL),v);
+    return dot(z,z);
+  };
+};
+
+/*
+ * NIWStats together with the NIW posterior under them for the collapsed
+ * Gibbs samplers: kappa, nu, the posterior mean and the lower Cholesky 
+ * factor of the posterior Delta are kept up to date. Adding or removing a
+ * single point is a rank-one update/downdate of the factor, hence seating 
+ * or unseating a customer and evaluating the predictive cost O(d^2).
+ */
+class NIWPosteriorStats : public NIWStats
+{
+public:
+  NIWPosteriorStats(const NIW& prior)
+    : NIWStats(prior.mVtheta.n_elem), mVtheta0(prior.mVtheta), mKappa0(prior.mKappa),
+    mDelta0(prior.mDelta), mNu0(prior.mNu)
+  {
+    zero();
+  };
+
+  virtual NIWPosteriorStats* getCopy() const
+  {
+    return new NIWPosteriorStats(*this);
+  };
+
+  virtual void add(const Col<double>& x, double w=1.0)
+  {
+    NIWStats::add(x,w);
+    // Delta' = Delta + (kappa*w)/(kappa+w) (x-vtheta)(x-vtheta)^T also for w<0
+    double c = (mKappa*w)/(mKappa+w);
+    colvec v = sqrt(fabs(c))*(x-mVtheta);
+    mVtheta = (mKappa*mVtheta + w*x)/(mKappa+w);
+    mKappa += w;
+    mNu += w;
+    if (mN == 0.0)
+      refactor(); // back to the prior; drops the round off of the updates
+    else if (!mCholOk || !cholUpdate(mL,v,c>0.0?1.0:-1.0))
+      refactor(); // downdate lost positive definiteness numerically
+  };
+
+  // refactors once instead of X.n_cols rank-one updates
+  virtual void addBatch(const Mat<double>& X, const Col<double>& w)
+  {
+    NIWStats::addBatch(X,w);
+    refactor();
+  };
+
+  virtual void merge(const SuffStats<double>& ss, double w=1.0)
+  {
+    NIWStats::merge(ss,w);
+    refactor();
+  };
+
+  virtual void zero()
+  {
+    NIWStats::zero();
+    refactor();
+  };
+
+  // Student-t predictive of x_q under the posterior; O(d^2)
+  double predictiveProb(const colvec& x_q) const
+  {
+    double d = mVtheta.n_elem;
+    if (mCholOk && mNu-d+1.0 > 0.0)
+      return NIW::logStudentT(x_q, mVtheta, mL, mKappa, mNu);
+    return NIW(mVtheta,mKappa,delta(),mNu).predictiveProb(x_q);
+  };
+
+  // posterior parameters
+  colvec mVtheta;
+  double mKappa;
+  double mNu;
+
+protected:
+  colvec mVtheta0;
+  double mKappa0;
+  mat mDelta0;
+  double mNu0;
+
+  bool mCholOk; // false if the posterior Delta is not positive definite
+  mat mL; // lower Cholesky factor of the posterior Delta
+
+  // posterior Delta from the centered sufficient statistics; O(d^2)
+  mat delta() const
+  {
+    colvec dx = mMean - mVtheta0;
+    return mDelta0 + mScatter + (mKappa0*mN/mKappa)*dx*dx.t();
+  };
+
+  // posterior from the sufficient statistics; O(d^3)
+  void refactor()
+  {
+    mKappa = mKappa0 + mN;
+    mNu = mNu0 + mN;
+    mVtheta = (mKappa0*mVtheta0 + mN*mMean)/mKappa;
+    mCholOk = chol(mL,delta());
+    if (mCholOk)
+      mL = trans(mL); // chol gives the upper factor
+  };
+};
+
+inline NIWStats* NIW::newStats() const
+{
+  return new NIWPosteriorStats(*this);
+};
+
+inline double NIW::predictiveProb(const Col<double>& x_q, const Mat<double>& x_given) const
+{
+  NIWPosteriorStats ss(*this);
+  ss.addBatch(x_given,ones<colvec>(x_given.n_cols));
+  return ss.predictiveProb(x_q);
+};
+
+inline double NIW::predictiveProb(const Col<double>& x_q, const SuffStats<double>& ss) const
+{
+  return static_cast<const NIWPosteriorStats&>(ss).predictiveProb(x_q);
+};
+
+/*
+ * number of points, sum and sum of squares of each dimension of the points
+ * of a NormalGamma
+ */
+class NormalGammaStats : public SuffStats<double>
+{
+public:
+  NormalGammaStats(uint32_t d)
+  {
+    mSum.zeros(d);
+    mSumSq.zeros(d);
+  };
+
+  virtual NormalGammaStats* getCopy() const
+  {
+    return new NormalGammaStats(*this);
+  };
+
+  virtual void add(const Col<double>& x, double w=1.0)
+  {
+    mN += w;
+    mSum += w*x;
+    mSumSq += w*square(x);
+  };
+
+  virtual void addBatch(const Mat<double>& X, const Col<double>& w)
+  {
+    mN += sum(w);
+    mSum += X*w;
+    mSumSq += square(X)*w;
+  };
+
+  virtual void merge(const SuffStats<double>& ss, double w=1.0)
+  {
+    const NormalGammaStats& o = static_cast<const NormalGammaStats&>(ss);
+    mN += w*o.mN;
+    mSum += w*o.mSum;
+    mSumSq += w*o.mSumSq;
+  };
+
+  virtual void zero()
+  {
+    mN = 0.0;
+    mSum.zeros();
+    mSumSq.zeros();
+  };
+
+  colvec mSum;
+  colvec mSumSq;
+};
+
+/*
+ * Normal-Gamma distribution with diagonal covariance: each of the d 
+ * dimensions has its own precision tau_j ~ Gamma(alpha, beta_j) and 
+ * mean mu_j ~ N(vmu_j, 1/(kappa*tau_j)). All operations are O(d) per point
+ * and work on contiguous vectors, which makes it the base measure of 
+ * choice for high dimensional features where NIW's O(d^3) is prohibitive.
+ */
+class NormalGamma : public BaseMeasure<double>
+{
+public:
+  typedef Gauss ModeType;
+
+  NormalGamma(colvec vmu, double kappa, double alpha, colvec beta)
+  : mVmu(vmu), mKappa(kappa), mAlpha(alpha), mBeta(beta)
+  {
+    mRowDim = 2*mVmu.n_elem +2;
+    updateCache();
+  };
+
+  NormalGamma(const NormalGamma& ng)
+  : mVmu(ng.mVmu), mKappa(ng.mKappa), mAlpha(ng.mAlpha), mBeta(ng.mBeta),
+    mPrec(ng.mPrec), mElogConst(ng.mElogConst), mPredConst(ng.mPredConst), mPredScale(ng.mPredScale),
+    mCacheDirty(ng.mCacheDirty)
+  {
+    mRowDim = 2*mVmu.n_elem +2;
+  };
+
+  virtual NormalGamma* getCopy() const
+  {
+    return new NormalGamma(*this);
+  };
+
+  /*
+   * puts all parameters into one vector
+   * (0 to d-1) beta
+   * (d to 2d-1) vmu
+   * (2d) alpha
+   * (2d+1) kappa 
+   */
+  virtual Row<double> asRow() const
+  {
+    uint32_t d = mVmu.n_elem;
+    Row<double> row(2*d+2);
+    row.cols(0,d-1) = mBeta.t();
+    row.cols(d,2*d-1) = mVmu.t();
+    row(2*d) = mAlpha;
+    row(2*d+1) = mKappa;
+    return row;
+  };
+
+  virtual void fromRow(const Row<double>& row)
+  {
+    uint32_t d = mVmu.n_elem;
+    mBeta = row.cols(0,d-1).t();
+    mVmu = row.cols(d,2*d-1).t();
+    mAlpha = row(2*d);
+    mKappa = row(2*d+1);
+    updateCache();
+  };
+
+  virtual void axpy(double a, const BaseMeasure<double>& x, double b=1.0)
+  {
+    const NormalGamma& ng = static_cast<const NormalGamma&>(x);
+    if (b != 1.0)
+    {
+      mBeta *= b;
+      mVmu *= b;
+    }
+    mBeta += a*ng.mBeta;
+    mVmu += a*ng.mVmu;
+    mAlpha = b*mAlpha + a*ng.mAlpha;
+    mKappa = b*mKappa + a*ng.mKappa;
+    mCacheDirty = true;
+  };
+
+  virtual void scale(double s)
+  {
+    mBeta *= s;
+    mVmu *= s;
+    mAlpha *= s;
+    mKappa *= s;
+    mCacheDirty = true;
+  };
+
+  virtual void zero()
+  {
+    mBeta.zeros();
+    mVmu.zeros();
+    mAlpha = 0.0;
+    mKappa = 0.0;
+    mCacheDirty = true;
+  };
+
+  virtual void refresh() const
+  {
+    if (mCacheDirty) updateCache();
+  };
+
+  virtual BaseMeasure<double>* mode() const
+  { 
+    // joint mode of (mu,tau) is (vmu, (alpha-1/2)/beta)
+    return new Gauss(mVmu,diagmat(mBeta/(mAlpha-0.5)));
+  };
+
+  virtual double Elog(const Col<double>& x) const
+  {
+    refresh();
+    return mElogConst -0.5*dot(mPrec,square(x-mVmu));
+  };
+
+  virtual void ElogBatch(const Mat<double>& X, Row<double>& eLog) const
+  {
+    refresh();
+    Mat<double> V = X;
+    V.each_col() -= mVmu;
+    eLog = mElogConst -0.5*(mPrec.t()*square(V));
+  };
+
+  /*
+   * update parameters using observations x to form posterior for stochastic variational HDP
+   */
+  virtual void posteriorHDP_var(const Col<double>& zeta, const Mat<double>& phi, uint32_t D, const Mat<double>& x)
+  {
+    Col<double> w = phi*zeta; // responsibility of this topic for each point
+    posterior(x,w,D);
+  };
+
+  virtual void posteriorHDP_var(const SuffStats<double>& ss, uint32_t D)
+  {
+    const NormalGammaStats& st = static_cast<const NormalGammaStats&>(ss);
+    if (st.mN <= 0.0) return;
+    Col<double> x_hat = st.mSum/st.mN;
+    posterior(D*st.mN,x_hat,D*(st.mSumSq - st.mN*square(x_hat)));
+  };
+
+  virtual void posterior(const Mat<double>& x)
+  {
+    Col<double> w(x.n_cols);
+    w.ones();
+    posterior(x,w,1);
+  };
+
+  virtual void posterior(const SuffStats<double>& ss)
+  {
+    posteriorHDP_var(ss,1);
+  };
+
+  virtual NormalGammaStats* newStats() const
+  {
+    return new NormalGammaStats(mVmu.n_elem);
+  };
+
+  double predictiveProb(const Col<double>& x_q, const Mat<double>& x_given) const
+  {
+    NormalGamma post(*this);
+    post.posterior(x_given);
+    return post.predictiveProb(x_q);
+  };
+
+  double predictiveProb(const Col<double>& x_q, const SuffStats<double>& ss) const
+  {
+    NormalGamma post(*this);
+    post.posterior(ss);
+    return post.predictiveProb(x_q);
+  };
+
+  /*
+   * the predictive is a product of d Student-t distributions with 2*alpha 
+   * degrees of freedom
+   */
+  double predictiveProb(const Col<double>& x_q) const
+  {
+    refresh();
+    return mPredConst -(mAlpha+0.5)*sum(log(1.0+mPredScale%square(x_q-mVmu)));
+  };
+
+  colvec mVmu;
+  double mKappa;
+  double mAlpha;
+  colvec mBeta;
+
+protected:
+  // cached quantities derived from the parameters (see updateCache() and refresh())
+  mutable colvec mPrec; // E[tau] = alpha/beta
+  mutable double mElogConst; // data independent part of Elog()
+  mutable double mPredConst; // log normalizer of predictiveProb()
+  mutable colvec mPredScale; // 1/(2*alpha*sigma_j^2) of the Student-t predictive
+  mutable bool mCacheDirty;
+
+  /*
+   * posterior under the points x weighted by w; the weighted statistics
+   * are scaled by D as in the SVI updates
+   */
+  void posterior(const Mat<double>& x, const Col<double>& w, uint32_t D)
+  {
+    double w0 = sum(w);
+    if (w0 <= 0.0) return;
+    double counts = D*w0;
+
+    Col<double> x_hat = x*w/w0;
+    Mat<double> xc = x;
+    xc.each_col() -= x_hat;
+    Col<double> S = square(xc)*w; // sum_n w_n (x_n-x_hat)^2
+    posterior(counts,x_hat,D*S);
+  };
+
+  /*
+   * posterior update from counts points with mean x_hat and centered sum 
+   * of squares S
+   */
+  void posterior(double counts, const colvec& x_hat, const colvec& S)
+  {
+    mBeta += 0.5*(S + (mKappa*counts)/(mKappa+counts)*square(x_hat - mVmu));
+    mVmu = mKappa/(mKappa+counts)* mVmu + counts/(mKappa+counts)*x_hat;
+    mKappa += counts;
+    mAlpha += 0.5*counts;
+    mCacheDirty = true;
+  };
+
+  void updateCache() const
+  {
+    mCacheDirty = false;
+    if (mKappa <= 0.0) return; // zeroed accumulator (see zero())
+    double d = mVmu.n_elem;
+    double sumLogBeta = sum(log(mBeta));
+    mPrec = mAlpha/mBeta;
+    // E[log N(x|mu,tau)] = sum_j 0.5*E[log tau_j] -0.5*log(2pi) -0.5*E[tau_j (x_j-mu_j)^2]
+    mElogConst = 0.5*d*digamma(mAlpha) -0.5*sumLogBeta -0.5*d*1.8378770664093453 -0.5*(d/mKappa);
+    // Student-t with nu=2 alpha and sigma_j^2 = beta_j (kappa+1)/(alpha kappa)
+    mPredScale = (0.5*mKappa/(mKappa+1.0))/mBeta;
+    mPredConst = d*(boost::math::lgamma(mAlpha+0.5) - boost::math::lgamma(mAlpha)) 
+      -0.5*d*log(2.0*datum::pi*(mKappa+1.0)/mKappa) -0.5*sumLogBeta;
+  };
+};
+
+
+/*
+ * declaringClass<A1[,A2]>(&H::f) deduces the class C which declares the 
+ * const member function f(A1[,A2]) -> C is BaseMeasure<U> if H only 
+ * inherits the stub
+ */
+template<class A1, class Rt, class C>
+C* declaringClass(Rt (C::*)(A1) const)
+{
+  return NULL;
+};
+
+template<class A1, class A2, class Rt, class C>
+C* declaringClass(Rt (C::*)(A1,A2) const)
+{
+  return NULL;
+};
+
+/*
+ * Static dispatch of the base measure calls of the inner loops. With H a 
+ * concrete base measure (Dir, NIW, NormalGamma, Mult, Gauss) the calls are 
+ * bound at compile time and can be inlined; using a method that H does not
+ * implement itself is a compile error instead of BaseMeasure's exit(0) at 
+ * runtime. The specialization for H=BaseMeasure<U> keeps the virtual calls
+ * (used by the python bindings).
+ */
+template<class U, class H>
+struct Measure
+{
+  static const H& of(const BaseMeasure<U>& h)
+  {
+    return static_cast<const H&>(h);
+  };
+
+  static double Elog(const BaseMeasure<U>& h, const Col<U>& x)
+  {
+    implements(declaringClass<const Col<U>&>(&H::Elog));
+    return of(h).H::Elog(x);
+  };
+
+  static void ElogBatch(const BaseMeasure<U>& h, const Mat<U>& X, Row<double>& eLog)
+  {
+    implements(declaringClass<const Mat<U>&, Row<double>&>(&H::ElogBatch));
+    of(h).H::ElogBatch(X,eLog);
+  };
+
+  static double predictiveProb(const BaseMeasure<U>& h, const Col<U>& x_q)
+  {
+    implements(declaringClass<const Col<U>&>(&H::predictiveProb));
+    return of(h).H::predictiveProb(x_q);
+  };
+
+  static double predictiveProb(const BaseMeasure<U>& h, const Col<U>& x_q, const Mat<U>& x_given)
+  {
+    implements(declaringClass<const Col<U>&, const Mat<U>&>(&H::predictiveProb));
+    return of(h).H::predictiveProb(x_q,x_given);
+  };
+
+  static double predictiveProb(const BaseMeasure<U>& h, const Col<U>& x_q, const SuffStats<U>& ss)
+  {
+    implements(declaringClass<const Col<U>&, const SuffStats<U>&>(&H::predictiveProb));
+    return of(h).H::predictiveProb(x_q,ss);
+  };
+
+  static double logP(const BaseMeasure<U>& h, const Col<U>& x)
+  {
+    implements(declaringClass<const Col<U>&>(&H::logP));
+    return of(h).H::logP(x);
+  };
+
+private:
+  // only compiles for members declared by H (a BaseMeasure<U>* does not convert to H*)
+  static void implements(const H*)
+  {};
+};
+
+template<class U>
+struct Measure<U, BaseMeasure<U> >
+{
+  static double Elog(const BaseMeasure<U>& h, const Col<U>& x)
+  {
+    return h.Elog(x);
+  };
+
+  static void ElogBatch(const BaseMeasure<U>& h, const Mat<U>& X, Row<double>& eLog)
+  {
+    h.ElogBatch(X,eLog);
+  };
+
+  static double predictiveProb(const BaseMeasure<U>& h, const Col<U>& x_q)
+  {
+    return h.predictiveProb(x_q);
+  };
+
+  static double predictiveProb(const BaseMeasure<U>& h, const Col<U>& x_q, const Mat<U>& x_given)
+  {
+    return h.predictiveProb(x_q,x_given);
+  };
+
+  static double predictiveProb(const BaseMeasure<U>& h, const Col<U>& x_q, const SuffStats<U>& ss)
+  {
+    return h.predictiveProb(x_q,ss);
+  };
+
+  static double logP(const BaseMeasure<U>& h, const Col<U>& x)
+  {
+    return h.logP(x);
+  };
+};
 
 /*
  * Container for base measure pointers
@@ -664,6 +1631,12 @@ public:
     return mDistris.size();
   };
 
+  // exchanges the base measures of the two containers (no copies)
+  void swap(DistriContainer<U>& a)
+  {
+    mDistris.swap(a.mDistris);
+  };
+
   void resize(uint32_t i)
   {
     mDistris.resize(i,NULL);
@@ -688,9 +1661,73 @@ private:
 };
 
 /*
- * Mixture of probabiliti distributions
+ * Container of sufficient statistics (see SuffStats); owns them
+ * templated on the unit
  */
 template <class U>
+class StatsContainer
+{
+public:
+
+  StatsContainer()
+  {};
+
+  ~StatsContainer()
+  {
+    for (uint32_t i=0; i<mStats.size(); ++i)
+      delete mStats[i];
+  };
+
+  // d empty statistics of the base measure a
+  void init(const BaseMeasure<U>& a, uint32_t d)
+  {
+    for (uint32_t i=0; i<mStats.size(); ++i)
+      delete mStats[i];
+
+    mStats.resize(d,NULL);
+    for (uint32_t i=0; i<d; ++i)
+      mStats[i] = a.newStats();
+  };
+
+  // appends empty statistics of the base measure a
+  void push_back(const BaseMeasure<U>& a)
+  {
+    mStats.push_back(a.newStats());
+  };
+
+  // deletes the statistics i; the ones behind move up by one
+  void erase(uint32_t i)
+  {
+    assert(i<mStats.size());
+    delete mStats[i];
+    mStats.erase(mStats.begin()+i);
+  };
+
+  SuffStats<U>* operator[](const uint32_t i) const
+  {
+    assert(i<mStats.size());
+    return mStats[i];
+  };
+
+  uint32_t size() const
+  {
+    return mStats.size();
+  };
+
+private:
+  vector<SuffStats<U>* > mStats;
+
+  // owns the statistics -> no copies
+  StatsContainer(const StatsContainer<U>& a);
+  StatsContainer<U>& operator=(const StatsContainer<U>& a);
+};
+
+/*
+ * Mixture of probabiliti distributions
+ * templated on the unit and the concrete type M of the distributions 
+ * (see Measure)
+ */
+template <class U, class M=BaseMeasure<U> >
 class Mixture
 {
   public:
@@ -698,7 +1735,7 @@ class Mixture
       : mDistris()
     { };
 
-    Mixture(const Mixture<U>& mix)
+    Mixture(const Mixture<U,M>& mix)
       : mDistris(mix.mDistris), mP(mix.mP)
     {};
 
@@ -710,7 +1747,7 @@ class Mixture
     {
       double p=0.0 ;
       for (uint32_t i=0; i<mDistris.size(); ++i)
-        p += mP[i]*exp(mDistris[i]->logP(x));
+        p += mP[i]*exp(Measure<U,M>::logP(*mDistris[i],x));
       return log(p);
     };  
 
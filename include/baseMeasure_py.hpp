@@ -69,3 +69,21 @@ public:
 
 };
 
+class NormalGamma_py : public NormalGamma
+{
+public:
+  NormalGamma_py(const numeric::array& vmu, double kappa, double alpha,
+      const numeric::array& beta) :
+    NormalGamma(np2col<double>(vmu),kappa,alpha,np2col<double>(beta))
+  {};
+  NormalGamma_py(const NormalGamma_py& ng) :
+    NormalGamma(ng)
+  {};
+
+  void asRow(const numeric::array& row)
+  {
+    Row<double> row_arma = NormalGamma::asRow();
+    Row<double> row_wrap = np2row<double>(row);
+    row_wrap = row_arma;
+  };
+};
@@ -0,0 +1,153 @@
+/* Copyright (c) 2012, Julian Straub <jstraub@csail.mit.edu>
+ * Licensed under the MIT license. See LICENSE.txt or
+ * http://www.opensource.org/licenses/mit-license.php */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <armadillo>
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace arma;
+
+/*
+ * Sequential source of documents; lets HDP_var train on corpora that do
+ * not fit into memory.
+ */
+template <class U>
+class CorpusReader
+{
+public:
+  virtual ~CorpusReader()
+  {};
+
+  // reads the next document into x; returns false at the end of the corpus
+  virtual bool next(Mat<U>& x) = 0;
+};
+
+/*
+ * Reads a corpus from a text file with one document per line: the number
+ * of rows of the document followed by its entries in column major order,
+ * e.g. "1 3 17 3 5" for the words 3,17,3,5 of a Dir document or
+ * "2 0.1 0.3 1.2 0.7" for two 2D points of a NIW document.
+ */
+template <class U>
+class TextCorpusReader : public CorpusReader<U>
+{
+public:
+  TextCorpusReader(const string& path)
+    : mIn(path.c_str())
+  {
+    if (!mIn.is_open())
+      cerr<<"TextCorpusReader: could not open "<<path<<endl;
+  };
+
+  bool next(Mat<U>& x)
+  {
+    string line;
+    while (getline(mIn,line))
+    {
+      istringstream ss(line);
+      uint32_t rows;
+      if (!(ss>>rows) || rows == 0) continue; // skip empty or malformed lines
+      vector<U> vals;
+      U v;
+      while (ss>>v) vals.push_back(v);
+      if (vals.size() == 0 || vals.size()%rows != 0)
+      {
+        cerr<<"TextCorpusReader: skipping document with "<<vals.size()<<" entries for "<<rows<<" rows"<<endl;
+        continue;
+      }
+      x.set_size(rows,vals.size()/rows);
+      for (uint32_t i=0; i<vals.size(); ++i)
+        x(i) = vals[i];
+      return true;
+    }
+    return false;
+  };
+
+private:
+  ifstream mIn;
+};
+
+/*
+ * CorpusReader over documents that are in memory already; hands out a copy
+ * of one document at a time.
+ */
+template <class U>
+class VectorCorpusReader : public CorpusReader<U>
+{
+public:
+  VectorCorpusReader(const vector<Mat<U> >& x)
+    : mX(x), mI(0)
+  {};
+
+  bool next(Mat<U>& x)
+  {
+    if (mI >= mX.size()) return false;
+    x = mX[mI++];
+    return true;
+  };
+
+private:
+  const vector<Mat<U> >& mX;
+  uint32_t mI;
+};
+
+/*
+ * Hands out minibatches of S documents from a CorpusReader. The next
+ * minibatch is read on a background thread while the current one is
+ * processed, which hides the IO and parsing latency behind the compute.
+ */
+template <class U>
+class BatchPrefetcher
+{
+public:
+  BatchPrefetcher(CorpusReader<U>& reader, uint32_t S)
+    : mReader(reader), mS(S)
+  {
+    mThread = boost::thread(&BatchPrefetcher<U>::load, this);
+  };
+
+  ~BatchPrefetcher()
+  {
+    if (mThread.joinable()) mThread.join();
+  };
+
+  /*
+   * waits for the prefetched minibatch, swaps it into batch and starts
+   * reading the next one
+   * @return false if the corpus is exhausted
+   */
+  bool next(vector<Mat<U> >& batch)
+  {
+    if (mThread.joinable()) mThread.join();
+    batch.swap(mNext);
+    if (batch.size() == 0) return false;
+    mThread = boost::thread(&BatchPrefetcher<U>::load, this);
+    return true;
+  };
+
+private:
+  CorpusReader<U>& mReader;
+  uint32_t mS;
+  vector<Mat<U> > mNext; // minibatch that is being prefetched
+  boost::thread mThread;
+
+  void load()
+  {
+    mNext.clear();
+    Mat<U> x;
+    while (mNext.size() < mS && mReader.next(x))
+      mNext.push_back(x);
+  };
+};
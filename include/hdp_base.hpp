@@ -58,19 +58,21 @@ class HDP // : public DP<U>
       return mX_ho.size();
     };
 
-    double perplexity(const Mat<U>& x_ho, const Mixture<U>& mix) const
+    template<class M>
+    double perplexity(const Mat<U>& x_ho, const Mixture<U,M>& mix) const
     {
 //      assert(x_ho.n_rows==1);
 
-      uint32_t N = x_ho.n_cols;
+      Col<double> w; // counts of the columns of x_ho
+      mH0.counts(x_ho,w);
       double perp = 0.0;
-      for (uint32_t i=0; i<N; ++i){
+      for (uint32_t i=0; i<x_ho.n_cols; ++i){
         //cout<<"c_z_n = "<<c[z[w]]<<" z_n="<<z[w]<<" w="<<w<<" N="<<N<<" x_w="<<x_ho[w]<<" topics.shape="<<topics.n_rows<<" "<<topics.n_cols;
 //        cout<<"x_ho_i="<<x_ho(i)<<"; logP_x_ho_i="<<logP(x_ho(i))<<endl;
-          perp -= mix.logP(x_ho.col(i)); // logP(x_ho(i));
+          perp -= w(i)*mix.logP(x_ho.col(i)); // logP(x_ho(i));
         //cout<<"w="<<w<<"\tx_ho_w="<<x_ho[w]<<"\tlogP="<<logP[w]<<"\tperp+="<<-double(x_ho[w])*logP[w]<<endl;
       } cout<<endl;
-      perp /= double(N);
+      perp /= sum(w);
       perp /= log(2.0); // since it is log base 2 in the perplexity formulation!
       perp = pow(2.0,perp);
 
@@ -129,7 +131,7 @@ protected:
       uint32_t K = lambda.size();
       topics.resize(K);
       for (uint32_t k=0; k<K; k++){
-        topics[k] = lambda[k]->mode()->getCopy();
+        topics[k] = lambda[k]->mode();
 
 //        cout<<lambda[k]->asRow();
 //        cout<<topics[k]->asRow();
@@ -12,6 +12,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <typeinfo>
+#include <limits>
 
 #include <boost/math/special_functions/gamma.hpp>
 #include <boost/math/special_functions/digamma.hpp>
@@ -21,12 +22,107 @@
 using namespace std;
 using namespace arma;
 
-template <class U>
+/*
+ * Seating of the Chinese restaurant franchise with cached occupancy counts.
+ * The tables of each restaurant and the dishes live in slots; closed slots
+ * go onto free lists and are reused. Hence opening or closing a table or a
+ * dish is O(1) and never relabels the others. Free slots have zero counts.
+ */
+class CRFSeating
+{
+public:
+  CRFSeating(uint32_t J)
+    : mK_jt(J), mN_jt(J), mFreeT(J), mT(J,0), mK(0), mM(0)
+  {};
+
+  uint32_t slotsT(uint32_t j) const { return mK_jt[j].size(); };
+  uint32_t slotsK() const { return mM_k.size(); };
+
+  // opens an empty table serving dish k in restaurant j; @return its slot
+  uint32_t openTable(uint32_t j, uint32_t k)
+  {
+    uint32_t t;
+    if (mFreeT[j].size() > 0)
+    {
+      t = mFreeT[j].back();
+      mFreeT[j].pop_back();
+    }else{
+      t = mK_jt[j].size();
+      mK_jt[j].push_back(0);
+      mN_jt[j].push_back(0);
+    }
+    mN_jt[j][t] = 0;
+    mT[j]++;
+    mM++;
+    serve(j,t,k);
+    return t;
+  };
+
+  // closes the empty table t of restaurant j (and its dish if no other table serves it)
+  void closeTable(uint32_t j, uint32_t t)
+  {
+    unserve(j,t);
+    mFreeT[j].push_back(t);
+    mT[j]--;
+    mM--;
+  };
+
+  // opens a dish that is not served yet; @return its slot
+  uint32_t openDish()
+  {
+    uint32_t k;
+    if (mFreeK.size() > 0)
+    {
+      k = mFreeK.back();
+      mFreeK.pop_back();
+    }else{
+      k = mM_k.size();
+      mM_k.push_back(0);
+    }
+    mK++;
+    return k;
+  };
+
+  // table t of restaurant j serves dish k
+  void serve(uint32_t j, uint32_t t, uint32_t k)
+  {
+    mK_jt[j][t] = k;
+    mM_k[k]++;
+  };
+
+  // table t of restaurant j stops serving its dish; a dish without tables is closed
+  void unserve(uint32_t j, uint32_t t)
+  {
+    uint32_t k = mK_jt[j][t];
+    if (--mM_k[k] == 0)
+    {
+      mFreeK.push_back(k);
+      mK--;
+    }
+  };
+
+  vector<vector<uint32_t> > mK_jt; // dish slot served at each table slot of restaurant j
+  vector<vector<uint32_t> > mN_jt; // number of customers at each table slot of restaurant j
+  vector<vector<uint32_t> > mFreeT; // free table slots of restaurant j
+  vector<uint32_t> mM_k; // number of tables serving each dish slot
+  vector<uint32_t> mFreeK; // free dish slots
+  vector<uint32_t> mT; // number of tables in each restaurant
+  uint32_t mK; // number of dishes
+  uint32_t mM; // number of tables in the franchise
+};
+
+/*
+ * Chinese restaurant franchise Gibbs sampler for the HDP
+ * H is the concrete type of the base measure (e.g. NIW); it binds the 
+ * predictive probabilities of the sampling loops at compile time (see 
+ * Measure). The default BaseMeasure<U> dispatches them virtually.
+ */
+template <class U, class H=BaseMeasure<U> >
 class HDP_gibbs : public HDP<U>
 {
   public:
     HDP_gibbs(const BaseMeasure<U>& base, double alpha, double omega)
-      : HDP<U>(base, alpha, omega)
+      : HDP<U>(base, alpha, omega), mSeed(time(0))
     {
       //    cout<<"Creating "<<typeid(this).name()<<endl;
     };
@@ -34,259 +130,216 @@ class HDP_gibbs : public HDP<U>
     ~HDP_gibbs()
     {	};
 
+    // seed of the random generators of the next densityEst() (default: time(0))
+    void setSeed(uint32_t seed)
+    {
+      mSeed = seed;
+    };
+
 
     // method for "one shot" computation without storing data in this class
     vector<Row<uint32_t> > densityEst(const vector<Mat<U> >& x, uint32_t Nw, uint32_t K0, uint32_t T0, uint32_t It)
     {
       mNw = Nw;
 
-      RandDisc rndDisc;
+      RandDisc rndDisc(mSeed); // distinct seeds -> independent streams
       // x is a list of numpy arrays: one array per document
       uint32_t J=x.size(); // number of documents
       vector<uint32_t> N(J,0);
       for (uint32_t j=0; j<J; ++j)
         N.at(j)=int(x[j].n_cols); // number of datapoints in each document
 
-      uint32_t K=K0; // number of clusters/dishes in the franchise
-      vector<uint32_t> T(J,0);   // number of tables in each restaurant
-      vector<Col<uint32_t> > t_ji(J); // assignment of a table in restaurant j to customer i -> stores table number for each customer (per restaurant)
-      vector<Col<uint32_t> > k_jt(J); // assignment of a dish in restaurant j at table t -> stores dish number for each table (per restaurant)
-      RandInt rndT(0,T0);
-      RandInt rndK(0,K0);
+      CRFSeating crf(J); // tables and dishes with their occupancy counts
+      vector<Col<uint32_t> > t_ji(J); // assignment of a table in restaurant j to customer i -> stores table slot for each customer (per restaurant)
+      // sufficient statistics of the customers eating each dish (indexed by 
+      // dish slot); kept up to date as customers and tables are reseated
+      StatsContainer<U> ss_k;
+      RandInt rndT(0,T0,mSeed+1);
+      RandInt rndK(0,K0,mSeed+2);
+      const uint32_t unopened = numeric_limits<uint32_t>::max();
+      vector<uint32_t> dish0(K0,unopened); // slots of the initial dishes; opened when first served
       for (uint32_t j=0; j<J; ++j)
       {
-        T[j]=T0;
+        vector<uint32_t> table0(T0,unopened); // slots of the initial tables; opened when first sat at
         t_ji[j] = rndT.draw(N[j]);
-        k_jt[j] = rndK.draw(T[j]);
+        for (uint32_t i=0; i<N[j]; ++i)
+        {
+          uint32_t& t = table0[t_ji[j](i)];
+          if (t == unopened)
+          {
+            uint32_t& k = dish0[rndK.draw()];
+            if (k == unopened) k = openDish(crf,ss_k);
+            t = crf.openTable(j,k);
+          }
+          t_ji[j](i) = t;
+          crf.mN_jt[j][t]++;
+          ss_k[crf.mK_jt[j][t]]->add(x[j].col(i));
+        }
       }
 
-      vector<Row<uint32_t> > z_ji(J);
-      vector<uint32_t> Tprev=T;   // number of tables in each restaurant
-      uint32_t Kprev=K;
+      vector<uint32_t> Tprev=crf.mT;   // number of tables in each restaurant
+      uint32_t Kprev=crf.mK;
       for (uint32_t tt=0; tt<It; ++tt)
       {
-        cout<<"---------------- Iteration "<<tt<<" K="<<K<<" -------------------"<<endl;
+        cout<<"---------------- Iteration "<<tt<<" K="<<crf.mK<<" -------------------"<<endl;
         // gibbs update for the customer assignments to tables
         for (uint32_t j=0; j<J; ++j)
         {
-          cout<<"@j="<<j<<"; N_j="<<N[j]<<"; T_j="<<T[j]<<endl;
+          cout<<"@j="<<j<<"; N_j="<<N[j]<<"; T_j="<<crf.mT[j]<<endl;
           uint32_t n_j=t_ji[j].n_rows;
           for (uint32_t i=0; i<N[j]; ++i)
           {
-            colvec l=zeros<colvec>(T[j]+K+1,1);
-            colvec f=zeros<colvec>(T[j]+K+1,1);
-            for (uint32_t t=0; t<T[j]; ++t)
+            // take x_ji out of its table and dish; an emptied table is closed
+            uint32_t t_i = t_ji[j](i);
+            ss_k[crf.mK_jt[j][t_i]]->remove(x[j].col(i));
+            if (--crf.mN_jt[j][t_i] == 0)
+              crf.closeTable(j,t_i);
+
+            const uint32_t Tj = crf.slotsT(j); // table slots
+            const uint32_t Ks = crf.slotsK(); // dish slots
+            colvec l(Tj+Ks+1);
+            // predictive of x_ji under each dish
+            colvec f_k(Ks);
+            for (uint32_t k=0; k<Ks; ++k)
+              if (crf.mM_k[k] > 0)
+                f_k(k) = Measure<U,H>::predictiveProb(this->mH0,x[j].col(i),*ss_k[k]);
+            for (uint32_t t=0; t<Tj; ++t)
             {
-              uint32_t n_jt=sum(t_ji[j]==t);
-              if (t_ji[j](i) == t) n_jt--;
-              if (n_jt == 0){
+              uint32_t n_jt=crf.mN_jt[j][t];
+              if (n_jt == 0){ // free slot
                 l[t]=math::nan();
                 continue;
               }
-              Mat<U> x_k_ji = getXinK(x,j,i,k_jt[j](t),k_jt,t_ji);
-              //HDP hdp_x_ji = posterior(x_k_ji); // compute posterior hdp given the data 
-              //cout<<"x_j="<<x[j].col(i)<<endl;
-              //cout<<"x_k_ji="<<x_k_ji<<endl;
-              double f_k_jt = this->mH0.predictiveProb(x[j].col(i),x_k_ji);
-              //cout<<"f_k_jt="<<f_k_jt<<endl;
-              //logGaus(x[j].col(i), hdp_x_ji.mVtheta, hdp_x_ji.mmCov()); // marginal probability of x_ji in cluster k/dish k given all other data in that cluster
-              f(t) = f_k_jt;
-              l(t) = log(n_jt/(n_j + this->mAlpha)) + f_k_jt;
-              //          if(x_k_ji.n_rows <3)
-              //            cout<<"x_k_ji="<<x_k_ji<<"size="<<x_k_ji.n_rows<<" x "<<x_k_ji.n_cols<<"\t mu="<<hdp_x_ji.mVtheta(0)<<" \t cov="<<hdp_x_ji.mmCov()(0)<<"\t f="<<f_k_jt<<endl;
+              l(t) = log(n_jt/(n_j + this->mAlpha)) + f_k(crf.mK_jt[j][t]);
             }
-            uint32_t m_=K; // number of dishes
-            for (uint32_t k=0; k<K; ++k)
+            uint32_t m_=crf.mK; // number of dishes
+            for (uint32_t k=0; k<Ks; ++k)
             {// handle cases where x_ji is seated at a new table with a existing dish
-              //Col<uint32_t> m_k = zeros<Col<uint32_t> >(1,1); //number of tables serving dish k 
-              uint32_t m_k = 0; //number of tables serving dish k 
-              for (uint32_t jj=0; jj<J; ++jj) 
-                m_k += sum(k_jt[jj] ==k);
+              uint32_t m_k = crf.mM_k[k]; //number of tables serving dish k 
               if(m_k ==0){
-                l[T[j]+k] = math::nan();
+                l[Tj+k] = math::nan();
                 continue;
               }
-              Mat<U> x_k_ji = getXinK(x,j,i,k,k_jt,t_ji,tt==It-1);
-              //HDP hdp_x_ji = posterior(x_k_ji); // compute posterior hdp given the data in 
-              double f_k =  this->mH0.predictiveProb(x[j].col(i),x_k_ji);
-              //logGaus(x[j].col(i), hdp_x_ji.mVtheta, hdp_x_ji.mmCov());  // marginal probability of x_ji in cluster k/dish k given all other data in that cluster
-              f(T[j]+k) = f_k;
-              l(T[j]+k) = log(this->mAlpha*m_k/((n_j+this->mAlpha)*(m_ + HDP<U>::mOmega))) + f_k; // TODO: shouldnt this be mAlpha of the posterior hdp?
+              l(Tj+k) = log(this->mAlpha*m_k/((n_j+this->mAlpha)*(m_ + HDP<U>::mOmega))) + f_k(k); // TODO: shouldnt this be mAlpha of the posterior hdp?
             }
             // handle the case where x_ji sits at a new table with a new dish
-            //        cout<<"ji=:"<<j<<" " <<i<<endl;
-            //        cout<<"x_ji=:"<<x[j].col(i)<<endl;
-            //        cout<<"mVtheta=:"<<mVtheta<<endl;
-            //        cout<<"Cov=:"<<mmCov()<<endl;
-            //
-            double f_knew = this->mH0.predictiveProb(x[j].col(i));
-            //logGaus(x[j].col(i), mVtheta, mmCov());
-            f[T[j]+K] = f_knew;
-            l[T[j]+K] = log(this->mAlpha*HDP<U>::mOmega/((n_j+this->mAlpha)*(m_+HDP<U>::mOmega))) + f_knew;
-
-            //        cout<<"l.n_elem= "<<l.n_elem<<" l="<<l.t()<<endl;
+            double f_knew = Measure<U,H>::predictiveProb(this->mH0,x[j].col(i));
+            l[Tj+Ks] = log(this->mAlpha*HDP<U>::mOmega/((n_j+this->mAlpha)*(m_+HDP<U>::mOmega))) + f_knew;
+
             uint32_t z_i = sampleDiscLogProb(rndDisc,l);
 
 #ifndef NDEBUG
             cout<<endl<<"l="<<l.t()<<" |l|="<<l.n_elem<<endl;
-            cout<<"T_j="<<T[j]<<"; K="<<K<<"; z_i="<<z_i<<endl;
+            cout<<"T_j="<<crf.mT[j]<<"; K="<<crf.mK<<"; z_i="<<z_i<<endl;
 #endif
-            if (z_i < T[j])
+            if (z_i < Tj)
             { // customer sits at existing table 
-              t_ji[j](i)=z_i; // update table information of customer i in restaurant j
+              t_i=z_i;
 #ifndef NDEBUG
               cout<<"customer sits at existing table "<<z_i<<endl;
 #endif
-            }else if (z_i-T[j] < K)
+            }else if (z_i-Tj < Ks)
             { // customer sits at new table with a already existing dish
-              t_ji[j](i)=T[j]; // update table information of customer i in restaurant j
-              k_jt[j].resize(k_jt[j].n_elem+1);
-              k_jt[j](k_jt[j].n_elem-1) = z_i-T[j]; // add a new table with the sampled dish
+              t_i=crf.openTable(j,z_i-Tj);
 #ifndef NDEBUG
-              cout<<"customer sits at new table with a already existing dish "<<z_i-T[j]<<" z_i="<<z_i<<" T_j="<<T[j]<<endl;
+              cout<<"customer sits at new table with a already existing dish "<<z_i-Tj<<" z_i="<<z_i<<" T_j="<<crf.mT[j]<<endl;
 #endif
-              T[j]++;
-            }else if (z_i == T[j]+K)
-            { // customer sits at a new table with a new dish
-              t_ji[j](i)=T[j]; // update table information of customer i in restaurant j
-              k_jt[j].resize(k_jt[j].n_elem+1);
-              k_jt[j](k_jt[j].n_elem-1)=K; // add a new table with a new dish
-              T[j]++;
-              K++;
+            }else{
+              // customer sits at a new table with a new dish
+              t_i=crf.openTable(j,openDish(crf,ss_k));
 #ifndef NDEBUG
               cout<<"customer sits at a new table with a new dish"<<endl;
 #endif
             }
+            t_ji[j](i)=t_i; // update table information of customer i in restaurant j
+            crf.mN_jt[j][t_i]++;
+            ss_k[crf.mK_jt[j][t_i]]->add(x[j].col(i));
           }
         }
-        //remove unused tables
-        for (uint32_t j=0; j<J; ++j) // find unused dishes 
-          for (int32_t t=T[j]-1; t>-1; --t)
-          {
-            //Col<uint32_t> contained = (t_ji[j]==t);
-            //contained=sum(contained);
-            uint32_t contained = sum(t_ji[j]==t);
-            if (contained == 0)
-            {
-              t_ji[j].elem(find(t_ji[j] >= t)) -=1;
-              T[j]--;
-              //cout<<"shed "<<t<<endl<<k_jt[j].t();
-              k_jt[j].shed_row(t);
-              //cout<<k_jt[j].t()<<endl;
-            }
-          }
 
         for (uint32_t j=0; j<J; ++j)
         {
-          cout<<"-- T["<<j<<"]="<<T[j]<<"; Tprev["<<j<<"]="<<Tprev[j]<<" deltaT["<<j<<"]="<<int32_t(T[j])-int32_t(Tprev[j])<<endl;
+          cout<<"-- T["<<j<<"]="<<crf.mT[j]<<"; Tprev["<<j<<"]="<<Tprev[j]<<" deltaT["<<j<<"]="<<int32_t(crf.mT[j])-int32_t(Tprev[j])<<endl;
         }
-        Tprev=T;
+        Tprev=crf.mT;
 
         cout<<" Gibbs update for k_jt"<<endl;
         for (uint32_t j=0; j<J; ++j)
         {
-          for (uint32_t t=0; t<T[j]; ++t)
+          vector<vector<uint32_t> > i_jt(crf.slotsT(j)); // customers sitting at each table
+          for (uint32_t i=0; i<N[j]; ++i)
+            i_jt[t_ji[j](i)].push_back(i);
+          for (uint32_t t=0; t<crf.slotsT(j); ++t)
           {
-            colvec l=zeros<colvec>(K+1,1);
-            colvec f=zeros<colvec>(K+1,1);
-            uint32_t m_ = 0; // number of tables 
-            for (uint32_t jj=0; jj<J; ++jj)
-              m_ += T[jj];
-            uvec i_jt=find(t == t_ji[j]);
-            Mat<U> x_jt = zeros<Mat<U> >(x[j].n_rows,i_jt.n_elem);
-            for (uint32_t i=0; i<i_jt.n_elem; ++i)
-              x_jt.col(i) = x[j].col(i_jt(i)); //all datapoints which are sitting at table t 
-            for (uint32_t k=0; k<K; ++k)
+            if (crf.mN_jt[j][t] == 0) continue; // free slot
+            // take the table out of its dish
+            for (uint32_t i=0; i<i_jt[t].size(); ++i)
+              ss_k[crf.mK_jt[j][t]]->remove(x[j].col(i_jt[t][i]));
+            crf.unserve(j,t);
+
+            const uint32_t Ks = crf.slotsK();
+            colvec l(Ks+1);
+            uint32_t m_ = crf.mM; // number of tables 
+            for (uint32_t k=0; k<Ks; ++k)
             {
-              uint32_t m_k = 0; // number of tables serving dish k 
-              for (uint32_t jj=0; jj<J; ++jj)
-                m_k += sum(k_jt[jj] == k);
+              uint32_t m_k = crf.mM_k[k]; // number of tables serving dish k 
               if (m_k == 0){
                 l(k) = math::nan();
                 continue;
               }
-              double f_k=0.0;
-              for (uint32_t i=0; i<x_jt.n_cols; ++i)
-              { // product over independent x_ji_t
-                Mat<U> x_k_ji = getXinK(x,j,i_jt(i),k,k_jt,t_ji); // for posterior computation
-                //HDP hdp_x_ji = posterior(x_k_ji); // compute posterior hdp given the data in 
-                f_k += this->mH0.predictiveProb(x_jt.col(i),x_k_ji);
-                //logGaus(x_jt.col(i), hdp_x_ji.mVtheta, hdp_x_ji.mmCov());
-              }
-              f(k)=f_k;
+              double f_k=logPredictive(x[j],i_jt[t],*ss_k[k]);
               l(k)=log(m_k/(m_ + HDP<U>::mOmega)) + f_k;
             }
-            double f_knew=0.0;
-            for (uint32_t i=0; i<x_jt.n_cols; ++i) // product over independent x_ji_t
-              f_knew += this->mH0.predictiveProb(x_jt.col(i));
-            //logGaus(x_jt.col(i), mVtheta, mmCov());
-            f(K)=f_knew;
-            l(K)=log(HDP<U>::mOmega/(m_ + HDP<U>::mOmega)) + f_knew; // update dish at table t in restaurant j
+            SuffStats<U>* ss_new = this->mH0.newStats();
+            double f_knew=logPredictive(x[j],i_jt[t],*ss_new);
+            delete ss_new;
+            l(Ks)=log(HDP<U>::mOmega/(m_ + HDP<U>::mOmega)) + f_knew; // update dish at table t in restaurant j
             uint32_t z_jt = sampleDiscLogProb(rndDisc, l);
 #ifndef NDEBUG
             cout<<endl<<"l="<<l.t()<<" |l|="<<l.n_elem<<endl;
-            cout<<"T_j="<<T[j]<<"; K="<<K<<"; z_jt="<<z_jt<<endl;
+            cout<<"T_j="<<crf.mT[j]<<"; K="<<crf.mK<<"; z_jt="<<z_jt<<endl;
 #endif
-            if (z_jt < K){
-              k_jt[j](t)=z_jt;
+            if (z_jt < Ks){
 #ifndef NDEBUG
               cout<<"Table "<<t<<" gets already existing meal "<<z_jt<<endl;
 #endif
-            }else if ( z_jt == K){
-              k_jt[j](t)=K;
-              K++;
+            }else{
+              z_jt=openDish(crf,ss_k);
 #ifndef NDEBUG
-              cout<<"Table "<<t<<" gets new meal "<<K-1<<endl;
+              cout<<"Table "<<t<<" gets new meal "<<z_jt<<endl;
 #endif
             }
+            crf.serve(j,t,z_jt);
+            for (uint32_t i=0; i<i_jt[t].size(); ++i)
+              ss_k[z_jt]->add(x[j].col(i_jt[t][i]));
           }
         }
 
-        //    for (uint32_t j=0; j<J; ++j)
-        //      cout<<"k_jt="<<k_jt[j].t()<<endl;
-        // remove unused dishes
-        Col<uint32_t> k_used=k_jt[0];
-        Col<uint32_t> k_unused=zeros<Col<uint32_t> >(K,1);
-        for (uint32_t j=0; j<J; ++j)
-        { 
-          k_used.insert_rows(k_used.n_elem,k_jt[j]);
-        }
-        uint32_t k_sum;
-        for (uint32_t k=0; k<K; ++k)
-        {// find unused dishes
-          k_sum = sum(k_used==k);
-          k_unused(k) = k_sum>0?0:1;
-        }
-        for (int32_t k=K-1; k>-1; --k) // iterate from large to small so that the indices work out when deleting
-          if (k_unused(k)==1){
-            for (uint32_t j=0; j<J; ++j)
-            {
-              Col<uint32_t> ids=find(k_jt[j]>=k);
-              for(uint32_t i=0; i<ids.n_elem; ++i)
-                k_jt[j](ids(i)) -= 1;
-              //cout<<k_jt[j].elem(find(k_jt[j]>=k))<<endl;
-            }
-            K--;
-          }
+        cout<<"-- K="<<crf.mK<<"; Kprev="<<Kprev<<" deltaK="<<int32_t(crf.mK)-int32_t(Kprev)<<endl;
+        Kprev=crf.mK;
+      }
 
-        cout<<"-- K="<<K<<"; Kprev="<<Kprev<<" deltaK="<<int32_t(K)-int32_t(Kprev)<<endl;
-        //    for (uint32_t j=0; j<J; ++j)
-        //      cout<<"k_jt="<<k_jt[j].t()<<endl;
-        for (uint32_t j=0; j<J; ++j)
+      // number the dishes that are served 0..K-1 for the labels
+      vector<uint32_t> dishes; // slot of each dish
+      Col<uint32_t> label(crf.slotsK());
+      for (uint32_t k=0; k<crf.slotsK(); ++k)
+        if (crf.mM_k[k] > 0)
         {
-          z_ji[j].set_size(N[j]);
-          z_ji[j].zeros();
-          for (uint32_t i=0; i<N[j]; ++i)
-            z_ji[j](i)=k_jt[j](t_ji[j](i));
-          //cout<<"z_ji["<<j<<"]="<<z_ji[j].t()<<" |.|="<<z_ji[j].n_elem<<endl;
+          label(k) = dishes.size();
+          dishes.push_back(k);
         }
-
+      vector<Row<uint32_t> > z_ji(J);
+      for (uint32_t j=0; j<J; ++j)
+      {
+        z_ji[j].set_size(N[j]);
+        for (uint32_t i=0; i<N[j]; ++i)
+          z_ji[j](i)=label(crf.mK_jt[j][t_ji[j](i)]);
       }
       mZ_ji = z_ji;
-      mK = K;
-      mT = T;
+      mK = crf.mK;
+      mT = crf.mT;
 
-      computeTopics(); // compute the corpus level topic distributions from the labels z_ji
+      computeTopics(ss_k,dishes); // compute the corpus level topic distributions from the dish statistics
 
       return z_ji;
     };
@@ -334,7 +387,7 @@ class HDP_gibbs : public HDP<U>
     };
 
 
-    Mixture<U> docMixture(uint32_t d) const 
+    Mixture<U,typename H::ModeType> docMixture(uint32_t d) const 
     {  
 //      uint32_t N = mZ_ji[d].n_elem;
       Col<uint32_t> z_u = unique(mZ_ji[d]);
@@ -343,9 +396,9 @@ class HDP_gibbs : public HDP<U>
       DistriContainer<U> beta(z_u.n_elem);
       for (uint32_t i=0; i < z_u.n_elem; ++i){
         ps[i] = sum(mZ_ji[d]==z_u(i));
-        beta[i] = mBeta[z_u(i)]->mode()->getCopy(); // TODO only works for Dir Base Measure I guess
+        beta[i] = mBeta[z_u(i)]->mode();
       }
-      return Mixture<U>(beta,ps);
+      return Mixture<U,typename H::ModeType>(beta,ps);
 
     }
 
@@ -357,7 +410,7 @@ class HDP_gibbs : public HDP<U>
       for (uint32_t i=0; i<mX_id_test.size(); ++i){
         // iterate over all held out data and compute the perplexity
         uint32_t d=mX_id_test[i];
-        Mixture<U> mix = docMixture(d);
+        Mixture<U,typename H::ModeType> mix = docMixture(d);
         mPerp(i) = HDP<U>::perplexity(HDP<U>::mX_ho[i],mix);
       }
       return mPerp;
@@ -370,88 +423,50 @@ class HDP_gibbs : public HDP<U>
     vector<Row<uint32_t> > mZ_ji;
     uint32_t mNw; // number of different words 
     uint32_t mK;
+    uint32_t mSeed;
     vector<uint32_t> mT;
     DistriContainer<U> mBeta; // corpus level topics
     Row<double> mPerp; // perplexities of all test docs after sampling is finished
 
-  private:
-
-    //TODO: compute topics from the labeling
-    void computeTopics(void)
+    /*
+     * compute the corpus level topics as the posteriors under the statistics
+     * of the customers of each dish
+     * @param dishes slot of each of the mK dishes
+     */
+    void computeTopics(const StatsContainer<U>& ss_k, const vector<uint32_t>& dishes)
     {
       mBeta.init(HDP<U>::mH0,mK);
+      for (uint32_t k=0; k<mK; ++k)
+        mBeta[k]->posterior(*ss_k[dishes[k]]);
+    };
 
-      for (uint32_t k=0; k<mK; ++k){
-        Mat<U> x_k(HDP<U>::mX[0].n_rows,0);
-
-        uint32_t D=HDP<U>::mX.size(); // D=J -> number of documents in corpus; document d/j
-        for (uint32_t d=0; d<D; ++d){
-//          uint32_t N = mZ_ji[d].n_elem;
-          x_k = join_rows(x_k, HDP<U>::mX[d].cols(find(mZ_ji[d] == k )));
-
-//          for (uint32_t i=0; i<N; ++i){
-//            assert(mZ_ji[d](i)<mK);
-//            assert(HDP<U>::mX[d](i)<mNw);
-//            mBeta[
-//              mBeta(mZ_ji[d](i), HDP<U>::mX[d](i)) ++; // increment count for word x_di in topic z_di 
-//          }
-        }
-        mBeta[k]->posterior(x_k);
-      }
-
-//      //normalize
-//      for (uint32_t k=0; k<mK; ++k){
-//        mBeta.row(k) /= sum(mBeta.row(k));
-//      }
+    // opens a dish with empty statistics; @return its slot
+    uint32_t openDish(CRFSeating& crf, StatsContainer<U>& ss_k) const
+    {
+      uint32_t k = crf.openDish();
+      if (k == ss_k.size())
+        ss_k.push_back(this->mH0);
+      else
+        ss_k[k]->zero(); // reused slot; clears round off of the removals
+      return k;
     };
 
-    Mat<U> getXinK(const vector<Mat<U> >& x, uint32_t j_x, uint32_t i_x, uint32_t k, 
-        const vector<Col<uint32_t> >& k_jt, const vector<Col<uint32_t> >& t_ji, bool disp=false) const
+    /*
+     * log of the joint predictive of the points ids of x_j given the 
+     * statistics ss: the product of the predictives of each point given ss
+     * and the points before it; ss is unchanged afterwards
+     */
+    double logPredictive(const Mat<U>& x_j, const vector<uint32_t>& ids, SuffStats<U>& ss) const
     {
-      uint32_t J = k_jt.size();
-      Mat<U> x_k; // datapoints in cluster k
-#ifndef NDEBUG
-      if(disp) printf("----------- J=%d; j_x=%d; i_x=%d; k=%d; ----------- \n",J,j_x,i_x,k);
-#endif
-      for (uint32_t j=0; j<J; ++j)
+      double f=0.0;
+      for (uint32_t i=0; i<ids.size(); ++i)
       {
-        Col<uint32_t> T_k = find(k_jt[j] == k);
-#ifndef NDEBUG
-        if(disp) cout<<"k="<<k<<" k_jt[j]="<<k_jt[j].t();
-        if(disp) cout<<"@j="<<j<<" T_k="<<T_k.t();
-#endif
-        for (uint32_t i=0; i < T_k.n_elem; ++i)
-        { // for all tables with the dish k_jt
-          uvec id=find(t_ji[j] == T_k(i));
-          //uint32_t inThere=sum(id==i_x)
-          if(j_x==j)
-          {
-            Col<uint32_t> i_x_id=find(id==i_x);
-#ifndef NDEBUG
-            if(disp) cout<<"T_k(i)="<<T_k(i)<<"; i_x_id="<<i_x_id.t();
-#endif
-            if(i_x_id.n_elem > 0)
-              id.shed_row(i_x_id(0)); // make sure, that that j_x and i_x are not in the x_k
-          }
-#ifndef NDEBUG
-          if(disp) cout<<"t_ji[j]="<<t_ji[j].t();
-          if(disp) cout<<"id="<<id.t();
-          if(disp) cout<<"x_k_before="<<x_k<<endl;
-#endif
-          uint32_t offset=x_k.n_cols;
-          x_k.resize(x[j].n_rows,x_k.n_cols+id.n_elem);
-          for (uint32_t i=0; i<id.n_elem; ++i)
-            x_k.col(offset+i) = x[j].col(id(i)); // append all datapoints which are sitting at a table with dish k
-#ifndef NDEBUG
-          if(disp) cout<<"x_k_after="<<x_k<<endl;
-#endif
-        }
+        f += Measure<U,H>::predictiveProb(this->mH0,x_j.col(ids[i]),ss);
+        ss.add(x_j.col(ids[i]));
       }
-      //x_k.shed_col(0); // remove first row of zeros
-#ifndef NDEBUG
-      if(disp) cout<<x_k<<endl;
-#endif
-      return x_k;
+      for (uint32_t i=0; i<ids.size(); ++i)
+        ss.remove(x_j.col(ids[i]));
+      return f;
     };
 };
 
@@ -0,0 +1,307 @@
+/* Copyright (c) 2012, Julian Straub <jstraub@csail.mit.edu>
+ * Licensed under the MIT license. See LICENSE.txt or
+ * http://www.opensource.org/licenses/mit-license.php */
+
+#pragma once
+
+#include "random.hpp"
+#include "baseMeasure.hpp"
+#include "hdp_base.hpp"
+#include "probabilityHelpers.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <typeinfo>
+#include <limits>
+
+#include <armadillo>
+
+using namespace std;
+using namespace arma;
+
+/*
+ * Direct assignment Gibbs sampler for the HDP (Teh et al. 2006, sec. 5.3)
+ * Instead of tables and dishes each customer is assigned to a dish z_ji
+ * directly; the restaurants are coupled through the global stick weights
+ * beta. After each sweep the number of tables m_jk serving dish k in
+ * restaurant j is resampled by auxiliary variables (Antoniak) and beta by
+ * beta ~ Dir(m_.1, ..., m_.K, omega).
+ * Dishes live in slots that are reused once a dish is no longer eaten (as
+ * in CRFSeating); per dish sufficient statistics give the predictives.
+ * H is the concrete type of the base measure (see HDP_gibbs).
+ */
+template <class U, class H=BaseMeasure<U> >
+class HDP_gibbs_da : public HDP<U>
+{
+  public:
+    HDP_gibbs_da(const BaseMeasure<U>& base, double alpha, double omega)
+      : HDP<U>(base, alpha, omega), mSeed(time(0))
+    { };
+
+    ~HDP_gibbs_da()
+    {	};
+
+    // seed of the random generators of the next densityEst() (default: time(0))
+    void setSeed(uint32_t seed)
+    {
+      mSeed = seed;
+    };
+
+    // method for "one shot" computation without storing data in this class
+    vector<Row<uint32_t> > densityEst(const vector<Mat<U> >& x, uint32_t Nw, uint32_t K0, uint32_t It)
+    {
+      mNw = Nw;
+      const double alpha = this->mAlpha;
+      const double omega = HDP<U>::mOmega;
+
+      RandDisc rndDisc(mSeed); // distinct seeds -> independent streams
+      DirRnd rndDir(mSeed+1);
+      uint32_t J=x.size(); // number of documents
+      vector<uint32_t> N(J,0);
+      for (uint32_t j=0; j<J; ++j)
+        N.at(j)=x[j].n_cols; // number of datapoints in each document
+
+      vector<Row<uint32_t> > z_ji(J); // dish slot of each customer
+      Mat<uint32_t> n_jk(J,0); // number of customers of restaurant j eating dish slot k
+      vector<uint32_t> n_k; // number of customers eating dish slot k
+      vector<uint32_t> freeK; // free dish slots
+      uint32_t K=0; // number of dishes
+      StatsContainer<U> ss_k; // sufficient statistics of the customers of each dish slot
+      Row<double> beta; // global weights of the dish slots
+      double beta_u = 1.0; // global weight of all unused dishes
+
+      RandInt rndK(0,K0,mSeed+2);
+      const uint32_t unopened = numeric_limits<uint32_t>::max();
+      vector<uint32_t> dish0(K0,unopened); // slots of the initial dishes
+      for (uint32_t j=0; j<J; ++j)
+      {
+        z_ji[j].set_size(N[j]);
+        for (uint32_t i=0; i<N[j]; ++i)
+        {
+          uint32_t& k = dish0[rndK.draw()];
+          if (k == unopened)
+            k = openDish(K,n_k,freeK,n_jk,beta,ss_k);
+          z_ji[j](i) = k;
+          n_jk(j,k)++;
+          n_k[k]++;
+          ss_k[k]->add(x[j].col(i));
+        }
+      }
+      beta.fill(1.0/(K+1.0)); // all dish slots are in use at this point
+      beta_u = 1.0/(K+1.0);
+
+      uint32_t Kprev=K;
+      for (uint32_t tt=0; tt<It; ++tt)
+      {
+        cout<<"---------------- Iteration "<<tt<<" K="<<K<<" -------------------"<<endl;
+        if (K > 0)
+        {
+          // sample the number of tables m_jk serving dish k in restaurant j
+          // from the n_jk customers of a CRP with concentration alpha*beta_k
+          const uint32_t Ks = n_k.size();
+          Row<double> m_k(Ks+1); // number of tables serving each dish slot; last: omega
+          m_k.zeros();
+          for (uint32_t k=0; k<Ks; ++k)
+          {
+            if (n_k[k] == 0) continue;
+            for (uint32_t j=0; j<J; ++j)
+              m_k(k) += sampleTables(rndDisc,alpha*beta(k),n_jk(j,k));
+          }
+          m_k(Ks) = omega;
+          // sample the global weights
+          Row<double> beta_s;
+          rndDir.draw(beta_s,m_k);
+          beta = beta_s.cols(0,Ks-1);
+          beta_u = beta_s(Ks);
+#ifndef NDEBUG
+          cout<<"m_k="<<m_k<<"beta="<<beta<<"beta_u="<<beta_u<<endl;
+#endif
+        }
+
+        // gibbs update for the dish assignments of the customers
+        for (uint32_t j=0; j<J; ++j)
+        {
+          for (uint32_t i=0; i<N[j]; ++i)
+          {
+            // take x_ji out of its dish; a dish that is no longer eaten is closed
+            uint32_t k_i = z_ji[j](i);
+            ss_k[k_i]->remove(x[j].col(i));
+            n_jk(j,k_i)--;
+            if (--n_k[k_i] == 0)
+            {
+              freeK.push_back(k_i);
+              K--;
+              beta_u += beta(k_i);
+              beta(k_i) = 0.0;
+            }
+
+            const uint32_t Ks = n_k.size();
+            colvec l(Ks+1);
+            for (uint32_t k=0; k<Ks; ++k)
+            {
+              if (n_k[k] == 0){ // free slot
+                l(k) = math::nan();
+                continue;
+              }
+              l(k) = log(n_jk(j,k) + alpha*beta(k))
+                + Measure<U,H>::predictiveProb(this->mH0,x[j].col(i),*ss_k[k]);
+            }
+            l(Ks) = log(alpha*beta_u) + Measure<U,H>::predictiveProb(this->mH0,x[j].col(i));
+            k_i = sampleDiscLogProb(rndDisc,l);
+#ifndef NDEBUG
+            cout<<endl<<"l="<<l.t()<<" |l|="<<l.n_elem<<endl;
+            cout<<"K="<<K<<"; z_i="<<k_i<<endl;
+#endif
+            if (k_i == Ks)
+            { // new dish: break off its weight from the unused mass
+              double u = rndDisc.draw();
+              double b = 1.0 - pow(u,1.0/omega); // ~ Beta(1,omega)
+              k_i = openDish(K,n_k,freeK,n_jk,beta,ss_k);
+              beta(k_i) = b*beta_u;
+              beta_u *= 1.0-b;
+            }
+            z_ji[j](i) = k_i;
+            n_jk(j,k_i)++;
+            n_k[k_i]++;
+            ss_k[k_i]->add(x[j].col(i));
+          }
+        }
+        cout<<"-- K="<<K<<"; Kprev="<<Kprev<<" deltaK="<<int32_t(K)-int32_t(Kprev)<<endl;
+        Kprev=K;
+      }
+
+      // number the dishes that are eaten 0..K-1 for the labels
+      vector<uint32_t> dishes; // slot of each dish
+      Col<uint32_t> label(n_k.size());
+      for (uint32_t k=0; k<n_k.size(); ++k)
+        if (n_k[k] > 0)
+        {
+          label(k) = dishes.size();
+          dishes.push_back(k);
+        }
+      for (uint32_t j=0; j<J; ++j)
+        for (uint32_t i=0; i<N[j]; ++i)
+          z_ji[j](i) = label(z_ji[j](i));
+      mWeights.set_size(K);
+      for (uint32_t k=0; k<K; ++k)
+        mWeights(k) = beta(dishes[k]);
+      mZ_ji = z_ji;
+      mK = K;
+
+      computeTopics(ss_k,dishes); // compute the corpus level topic distributions from the dish statistics
+
+      return z_ji;
+    };
+
+    // compute density estimate based on data previously fed into the class using addDoc
+    bool densityEst(uint32_t Nw, uint32_t K0, uint32_t It)
+    {
+      if(HDP<U>::mX.size() > 0)
+      {
+        if(HDP<U>::mX_te.size() > 0){
+          // put the test docs mX_te into th normal docs and record their index
+          mX_id_test.resize(HDP<U>::mX_te.size());
+          for(uint32_t i=0; i<HDP<U>::mX_te.size(); ++i){
+            mX_id_test[i]= HDP<U>::mX.size(); // helps locate the documents wich are trained in order to get a topic model
+            HDP<U>::mX.push_back(HDP<U>::mX_te[i]);
+          }
+        }
+        mZ_ji = densityEst(HDP<U>::mX,Nw,K0,It);
+        return true;
+      }else{
+        return false;
+      }
+    };
+
+    // after computing the labels we can use this to get them.
+    bool getClassLabels(Col<uint32_t>& z_i, uint32_t i)
+    {
+      if(mZ_ji.size() > 0 && i < mZ_ji.size())
+      {
+        z_i=mZ_ji[i];
+        return true;
+      }else{
+        return false;
+      }
+    };
+
+    // global weights beta of the dishes after sampling
+    const Row<double>& getWeights() const
+    {
+      return mWeights;
+    };
+
+    Mixture<U,typename H::ModeType> docMixture(uint32_t d) const
+    {
+      Col<uint32_t> z_u = unique(mZ_ji[d]);
+      Row<double> ps(z_u.n_elem);
+
+      DistriContainer<U> beta(z_u.n_elem);
+      for (uint32_t i=0; i < z_u.n_elem; ++i){
+        ps[i] = sum(mZ_ji[d]==z_u(i));
+        beta[i] = mBeta[z_u(i)]->mode();
+      }
+      return Mixture<U,typename H::ModeType>(beta,ps);
+    }
+
+    /* compute the perplexity of all test docs after gibbs sampling is done
+     */
+    Row<double> perplexity()
+    {
+      mPerp.set_size(HDP<U>::mX_ho.size());
+      for (uint32_t i=0; i<mX_id_test.size(); ++i){
+        // iterate over all held out data and compute the perplexity
+        uint32_t d=mX_id_test[i];
+        Mixture<U,typename H::ModeType> mix = docMixture(d);
+        mPerp(i) = HDP<U>::perplexity(HDP<U>::mX_ho[i],mix);
+      }
+      return mPerp;
+    };
+
+  protected:
+
+    Row<uint32_t> mX_id_test; //  the id of the half of the test data in mX
+
+    vector<Row<uint32_t> > mZ_ji;
+    uint32_t mNw; // number of different words
+    uint32_t mK;
+    uint32_t mSeed;
+    Row<double> mWeights; // global weights beta of the dishes
+    DistriContainer<U> mBeta; // corpus level topics
+    Row<double> mPerp; // perplexities of all test docs after sampling is finished
+
+    /*
+     * compute the corpus level topics as the posteriors under the statistics
+     * of the customers of each dish
+     * @param dishes slot of each of the mK dishes
+     */
+    void computeTopics(const StatsContainer<U>& ss_k, const vector<uint32_t>& dishes)
+    {
+      mBeta.init(HDP<U>::mH0,mK);
+      for (uint32_t k=0; k<mK; ++k)
+        mBeta[k]->posterior(*ss_k[dishes[k]]);
+    };
+
+    // opens a dish with no customers, empty statistics and zero weight; @return its slot
+    uint32_t openDish(uint32_t& K, vector<uint32_t>& n_k, vector<uint32_t>& freeK,
+        Mat<uint32_t>& n_jk, Row<double>& beta, StatsContainer<U>& ss_k) const
+    {
+      uint32_t k;
+      if (freeK.size() > 0)
+      {
+        k = freeK.back();
+        freeK.pop_back();
+        ss_k[k]->zero(); // clears round off of the removals
+      }else{
+        k = n_k.size();
+        n_k.push_back(0);
+        n_jk.resize(n_jk.n_rows,k+1);
+        n_jk.col(k).zeros();
+        beta.resize(k+1);
+        ss_k.push_back(this->mH0);
+      }
+      beta(k) = 0.0;
+      K++;
+      return k;
+    };
+};
@@ -9,15 +9,24 @@
 
 #include "random.hpp"
 #include "baseMeasure.hpp"
+#include "topicBank.hpp"
+#include "corpusReader.hpp"
+#include "paramServer.hpp"
 #include "probabilityHelpers.hpp"
 
 #include <stddef.h>
 #include <stdint.h>
 #include <typeinfo>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 
 #include <boost/math/special_functions/gamma.hpp>
 #include <boost/math/special_functions/digamma.hpp>
 #include <boost/math/special_functions/beta.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
 #include <armadillo>
 
 using namespace std;
@@ -27,9 +36,22 @@ using namespace arma;
  * this one assumes that the number of words per document is 
  * smaller than the dictionary size
  *
+ * With a Dir base measure documents can also be given in the bag-of-words 
+ * form (see Dir::bagOfWords()); all local updates are then weighted by the 
+ * word counts, so their cost scales with the number of unique words.
+ *
+ * R is the real type of the doc level updates (phi, zeta and E[log beta]).
+ * With R=float they run at twice the SIMD width and half the memory traffic;
+ * gamma, the natural gradients, the global parameters and the stored 
+ * results stay double.
+ *
+ * H is the concrete type of the base measure (e.g. NIW); it binds the calls
+ * of the inner loops at compile time (see Measure). The default 
+ * BaseMeasure<U> dispatches them virtually.
+ *
  * http://en.wikipedia.org/wiki/Virtual_inheritance
  */
-template <class U>
+template <class U, class R=double, class H=BaseMeasure<U> >
 class HDP_var: public HDP<U>, public virtual HDP_var_base
 {
   public:
@@ -42,6 +64,7 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
     {};
 
     // interface mainly for python
+    // @return global number of the doc (counting docs discarded in streaming mode)
     uint32_t addDoc(const Mat<U>& x_i)
     {
       uint32_t x_ind = HDP<U>::addDoc(x_i);
@@ -49,7 +72,7 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
       // add the index of the added x_i
       mInd2Proc.resize(mInd2Proc.n_elem+1);
       mInd2Proc[mInd2Proc.n_elem-1] = x_ind;
-      return x_ind;
+      return x_ind+mDocsDiscarded;
     };
 
     /* 
@@ -90,6 +113,16 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
     void densityEst(const vector<Mat<U> >& x, uint32_t Nw, 
         double kappa, uint32_t K, uint32_t T, uint32_t S)
     {
+      if (mStreaming)
+      { // minibatches of S docs are copied in, processed and discarded one 
+        // after the other (see updateEst_batch(CorpusReader&,...))
+        bool added = (&x == &(HDP<U>::mX)); // docs added with addDoc()
+        vector<Mat<U> > docs;
+        HDP<U>::mX.swap(docs); // the reader path starts without docs in memory
+        VectorCorpusReader<U> reader(added ? docs : x);
+        densityEst(reader,Nw,kappa,K,T,S);
+        return;
+      }
       cout<<"densityEstimate with: K="<<K<<"; T="<<T<<"; kappa="<<kappa<<"; Nw="<<Nw<<"; S="<<S<<endl;
 
       HDP<U>::mX = x;
@@ -102,22 +135,24 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
       mT = T;
       mK = K;
       mNw = Nw;
+      mDocsDiscarded = 0;
+      mDocTopic.clear();
 
       initCorpusParams(mNw,mK,mT,D);
       cout<<"Init of corpus params done"<<endl;
-      Row<uint32_t> ind = updateEst_batch(mInd2Proc,mZeta,mPhi,mGamma,mA,HDP<U>::mLambda,mPerp,HDP<U>::mOmega,kappa,S,true);
+      Row<uint32_t> ind = updateEst_batch(mInd2Proc,mZeta,mPhi,mGamma,mA,HDP<U>::mLambda,mPerp,mLocalIt,HDP<U>::mOmega,kappa,S,true);
 //      cout<<"mPhi -> D="<<mPhi.size()<<endl;
 //      cout<<"mPhi -> D="<<HDP_var_base::mPhi.size()<<endl;
 //      cout<<"mPerp="<<mPerp.t()<<endl;
 
+      mInd2Proc.set_size(0); // all processed
+
       Mat<double> pi(D,T);
       Mat<double> sigPi(D,T+1);
       Mat<uint32_t> c(D,T);
       getDocTopics(pi,sigPi,c);
 //      cout<<"c:"<<c<<endl;
 
-      mInd2Proc.set_size(0); // all processed
-
     };
 
     /*
@@ -149,18 +184,36 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
         vector<Mat<double> > phi;
         vector<Mat<double> > gamma;
         Col<double> perp;
-
-        Row<uint32_t> ind = updateEst_batch(mInd2Proc,zeta,phi,gamma,mA,HDP<U>::mLambda,perp,HDP<U>::mOmega,kappa,S);
+        Col<uint32_t> localIt;
+
+        Row<uint32_t> ind = updateEst_batch(mInd2Proc,zeta,phi,gamma,mA,HDP<U>::mLambda,perp,localIt,HDP<U>::mOmega,kappa,S);
+
+        if (mStreaming)
+        { // only keep the summaries and the perplexities that were evaluated
+          if (mKeepSummaries)
+            for (uint32_t i=0; i<ind.n_elem; ++i)
+              storeDocSummary(mDocsDiscarded+ind[i],gamma[i],zeta[i]);
+          Col<double> perp_eval = perp.elem(find(perp != 0.0));
+          mPerp.resize(mPerp.n_elem+perp_eval.n_elem);
+          if (perp_eval.n_elem > 0)
+            mPerp.rows(mPerp.n_elem-perp_eval.n_elem,mPerp.n_elem-1) = perp_eval;
+          mLocalIt = localIt; // counts of this call only
+          mInd2Proc.set_size(0); // all processed
+          discardDocs();
+          return true;
+        }
 
         mZeta.resize(mZeta.size()+Db);
         mPhi.resize(mPhi.size()+Db);
         mGamma.resize(mGamma.size()+Db);
         mPerp.resize(mPerp.n_elem+Db);
         mPerp.rows(mPerp.n_elem-Db,mPerp.n_elem-1) = perp;
+        mLocalIt.resize(mLocalIt.n_elem+Db);
         for (uint32_t i=0; i<ind.n_elem; ++i){
           mZeta[ind[i]] = zeta[i];
           mPhi[ind[i]] = phi[i];
           mGamma[ind[i]] = gamma[i];
+          mLocalIt[ind[i]] = localIt[i];
         }
 
         mInd2Proc.set_size(0); // all processed
@@ -172,6 +225,138 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
       return false;
     };
 
+    /*
+     * out-of-core density estimate: all docs are pulled from reader in
+     * minibatches of S (see updateEst_batch(CorpusReader&,...))
+     */
+    bool densityEst(CorpusReader<U>& reader, uint32_t Nw, double kappa, uint32_t K, uint32_t T, uint32_t S)
+    {
+      cout<<"densityEstimate from reader with: K="<<K<<"; T="<<T<<"; kappa="<<kappa<<"; Nw="<<Nw<<"; S="<<S<<endl;
+      if (HDP<U>::mX.size() > 0)
+      {
+        cerr<<"densityEst: there are docs in memory; use densityEst(Nw,kappa,K,T,S) for them"<<endl;
+        return false;
+      }
+      mT = T;
+      mK = K;
+      mNw = Nw;
+      mDocsDiscarded = 0;
+      mDocTopic.clear();
+      mPerp.reset();
+      initCorpusParams(mNw,mK,mT,0);
+      return updateEst_batch(reader,kappa,S);
+    };
+
+    /*
+     * updates the estimate with all docs of reader. Minibatches of S docs 
+     * are prefetched on a background thread while the current one is 
+     * processed. The docs are never all in memory, hence this runs in 
+     * streaming mode (see setStreaming()); the previous mode is restored 
+     * on return.
+     */
+    bool updateEst_batch(CorpusReader<U>& reader, double kappa, uint32_t S)
+    {
+      if (HDP<U>::mX.size() > 0)
+      {
+        cerr<<"updateEst_batch: process the docs in memory before reading from a corpus"<<endl;
+        return false;
+      }
+      bool streaming = mStreaming;
+      mStreaming = true;
+      BatchPrefetcher<U> prefetcher(reader,S);
+      vector<Mat<U> > batch;
+      bool updated = false;
+      while (prefetcher.next(batch))
+      {
+        HDP<U>::mX.swap(batch); // mX is empty again after the streaming update
+        uint32_t Db = HDP<U>::mX.size();
+        mInd2Proc = linspace<Row<uint32_t> >(0,Db-1,Db);
+        updated = updateEst_batch(kappa,S) || updated;
+      }
+      mStreaming = streaming;
+      return updated;
+    };
+
+    /*
+     * Data parallel density estimate (Dir base measure only): the docs are 
+     * sharded over P forked worker processes which run the doc level updates
+     * and exchange E[log beta] and their sparse natural gradients with a 
+     * parameter server in this process over Unix domain sockets (see 
+     * DirParamServer). Only the globals mA and mLambda are estimated; the 
+     * local parameters stay in the workers.
+     */
+    bool densityEstDistributed(const vector<Mat<U> >& x, uint32_t Nw, double kappa, uint32_t K, uint32_t T, uint32_t S, uint32_t P)
+    {
+      cout<<"densityEstDistributed with: K="<<K<<"; T="<<T<<"; kappa="<<kappa<<"; Nw="<<Nw<<"; S="<<S<<"; P="<<P<<endl;
+      const Dir* dir = dynamic_cast<const Dir*>(&(HDP<U>::mH0));
+      if (dir == NULL)
+      {
+        cerr<<"densityEstDistributed: only implemented for a Dir base measure"<<endl;
+        return false;
+      }
+      mT = T;
+      mK = K;
+      mNw = Nw;
+      initCorpusParams(mNw,mK,mT,x.size());
+      DirTopicBank bank;
+      bank.init(HDP<U>::mLambda, dir->mAlphas);
+
+      vector<int> fds;
+      vector<pid_t> pids;
+      for (uint32_t p=0; p<P; ++p)
+      {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        {
+          cerr<<"densityEstDistributed: socketpair failed; running with "<<p<<" workers"<<endl;
+          break;
+        }
+        pid_t pid = fork();
+        if (pid == 0)
+        { // worker process
+          psWorkerInit(); // the thread pools of the parent do not survive fork()
+          close(sv[0]);
+          for (uint32_t q=0; q<fds.size(); ++q) close(fds[q]);
+          DirParamClient ps(sv[1], mK);
+          bool ok = workerLoop(ps, x, p, P, S);
+          ps.done();
+          close(sv[1]);
+          _exit(ok?0:1);
+        }
+        close(sv[1]);
+        if (pid < 0)
+        {
+          close(sv[0]);
+          cerr<<"densityEstDistributed: fork failed; running with "<<p<<" workers"<<endl;
+          break;
+        }
+        fds.push_back(sv[0]);
+        pids.push_back(pid);
+      }
+
+      DirParamServer server(bank, mA, kappa);
+      server.serve(fds);
+      bool ok = (fds.size() > 0);
+      for (uint32_t p=0; p<fds.size(); ++p)
+      {
+        close(fds[p]);
+        int status;
+        waitpid(pids[p], &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+      }
+      bank.toContainer(HDP<U>::mLambda);
+      cout<<"densityEstDistributed: applied the gradients of "<<server.docCount()<<" docs"<<endl;
+      return ok;
+    };
+
+    /*
+     * data parallel density estimate using the docs previously added with addDoc
+     */
+    bool densityEstDistributed(uint32_t Nw, double kappa, uint32_t K, uint32_t T, uint32_t S, uint32_t P)
+    {
+      return densityEstDistributed(HDP<U>::mX,Nw,kappa,K,T,S,P);
+    };
+
     /*
      * after an initial densitiy estimate has been made using densityEst()
      * can use this to update the estimate with information from additional x 
@@ -190,9 +375,10 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
         mGamma.push_back(Mat<double>(T,2));
         uint32_t d = HDP<U>::mX.size()-1;
         mPerp.resize(d+1);
+        mLocalIt.resize(d+1);
 
 
-        if(updateEst(HDP<U>::mX[d],mZeta[d],mPhi[d],mGamma[d],mA,HDP<U>::mLambda,HDP<U>::mOmega,d,kappa))
+        if(updateEst(HDP<U>::mX[d],mZeta[d],mPhi[d],mGamma[d],mA,HDP<U>::mLambda,HDP<U>::mOmega,d,kappa,mLocalIt[d]))
         {
           mPerp[d] = 0.0;
           for (uint32_t i=0; i < HDP<U>::mX_ho.size(); ++i)
@@ -213,25 +399,57 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
     };
 
     /*
-     *
+     * @param localIt number of doc level iterations that were needed
      */
-    bool updateEst(const Mat<U>& x, Mat<double>& zeta, Mat<double>& phi, Mat<double>& gamma, Mat<double>& a, DistriContainer<U>& lambda, double omega, uint32_t d, double kappa)
+    bool updateEst(const Mat<U>& x, Mat<double>& zeta, Mat<double>& phi, Mat<double>& gamma, Mat<double>& a, DistriContainer<U>& lambda, double omega, uint32_t d, double kappa, uint32_t& localIt)
     {
       uint32_t D = d+1; // assume that doc d is appended to the end  
-//      uint32_t Nw = lambda.n_cols;
-      uint32_t T = zeta.n_rows;
       uint32_t K = zeta.n_cols;
+      localIt = updateLocal(x,zeta,phi,gamma,a,lambda);
+
+      //    cout<<" --------------------- natural gradients --------------------------- "<<endl;
+      //    cout<<"\tD="<<D<<" omega="<<omega<<endl;
+      DistriContainer<U> d_lambda(HDP<U>::mH0,K);
+      Mat<double> d_a(K,2); 
+      computeNaturalGradients(d_lambda, d_a, zeta, phi, omega, D, x);
+
+      cout<<"update::d_lambda:"<<d_lambda.toMat().rows(0,5);
+      cout<<"update::lambda:"<<lambda.toMat().rows(0,5);
+
+      //    cout<<" ------------------- global parameter updates: ---------------"<<endl;
+      double ro = exp(-kappa*log(1+double(d+1)));
+      //    cout<<"\tro="<<ro<<endl;
+      for (uint32_t k=0; k<mK; ++k)
+      {
+        lambda[k]->axpy(ro, *d_lambda[k], 1.0-ro);
+        lambda[k]->refresh(); // the only factorization per topic and update
+      }
+
+      //lambda = (1.0-ro)*lambda + ro*d_lambda;
+      a = (1.0-ro)*a+ ro*d_a;
+      return true;
+    };
 
-      Mat<double> eLogBeta(mK,x.n_cols); //TODO
-      Col<double> digam_lamb_sum(mK);
+    /*
+     * doc level updates of zeta, phi and gamma of the doc x under the 
+     * globals a and lambda
+     * @return number of doc level iterations that were needed
+     */
+    uint32_t updateLocal(const Mat<U>& x, Mat<double>& zeta, Mat<double>& phi, Mat<double>& gamma, const Mat<double>& a, const DistriContainer<U>& lambda) const
+    {
+      uint32_t T = zeta.n_rows;
+      uint32_t K = zeta.n_cols;
 
-      compElogBeta(eLogBeta,  lambda, x);
+      Mat<double> eLogBeta(mK,x.n_cols); 
+      compElogBeta(eLogBeta, lambda, x, Mat<double>()); // single doc -> cheaper without the table
+      Col<double> w; // counts for each column of x
+      HDP<U>::mH0.counts(x,w);
 
       Col<double> eLogSig_a(K);
       compElogSig(eLogSig_a, a);
 
       //    cout<<"---------------- Document "<<d<<" N="<<N<<" -------------------"<<endl;
-      initZeta(zeta,eLogBeta);
+      initZeta(zeta,eLogBeta,w);
       initPhi(phi,zeta,eLogBeta);
 
       if(!is_finite(zeta))
@@ -254,7 +472,7 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
       uint32_t o=0;
       while(!converged){
         //      cout<<"-------------- Iterating local params #"<<o<<" -------------------------"<<endl;
-        updateGamma(gamma,phi);
+        updateGammaElogSig(gamma,eLogSig_gam,phi,w,HDP<U>::mAlpha);
 
         if (!is_finite(gamma)){
           cout<<"gamma="<<gamma;
@@ -263,12 +481,10 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
         }
 
 
-        compElogSig(eLogSig_gam,gamma); // precompute 
-
-        updateZeta(zeta,phi,eLogSig_a,eLogBeta);
+        updateZeta(zeta,phi,eLogSig_a,eLogBeta,w);
         updatePhi(phi,zeta,eLogSig_gam,eLogBeta);
 
-        converged = (accu(gamma_prev != gamma))==0 || o>60 ;
+        converged = localConverged(gamma_prev,gamma,o);
         gamma_prev = gamma;
         ++o;
 
@@ -281,24 +497,7 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
         }
       }
 
-      //    cout<<" --------------------- natural gradients --------------------------- "<<endl;
-      //    cout<<"\tD="<<D<<" omega="<<omega<<endl;
-      DistriContainer<U> d_lambda(HDP<U>::mH0,K);
-      Mat<double> d_a(K,2); 
-      computeNaturalGradients(d_lambda, d_a, zeta, phi, omega, D, x);
-
-      cout<<"update::d_lambda:"<<d_lambda.toMat().rows(0,5);
-      cout<<"update::lambda:"<<lambda.toMat().rows(0,5);
-
-      //    cout<<" ------------------- global parameter updates: ---------------"<<endl;
-      double ro = exp(-kappa*log(1+double(d+1)));
-      //    cout<<"\tro="<<ro<<endl;
-      for (uint32_t k=0; k<mK; ++k)
-        lambda[k]->fromRow( (1.0-ro)*lambda[k]->asRow() + ro* d_lambda[k]->asRow());
-
-      //lambda = (1.0-ro)*lambda + ro*d_lambda;
-      a = (1.0-ro)*a+ ro*d_a;
-      return true;
+      return o;
     };
 
 
@@ -308,10 +507,10 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
      * @param sameIndAsX == true -> zeta,phi,gamma have same indices as x (ind_x). This typically happens for the initial batch update. Setting this to true eliminates the need of reordering the results afterwords to match the indices of the docs x.
      * @return the randomly shuffled indices to show how the data was processed -> this allows association of zetas, phis and gammas with docs in mX
      */
-    Row<uint32_t> updateEst_batch(const Row<uint32_t>& ind_x, vector<Mat<double> >& zeta, vector<Mat<double> >& phi, vector<Mat<double> >& gamma, Mat<double>& a, DistriContainer<U>& lambda, Col<double>& perp, double omega, double kappa, uint32_t S, bool sameIndAsX=false)
+    Row<uint32_t> updateEst_batch(const Row<uint32_t>& ind_x, vector<Mat<double> >& zeta, vector<Mat<double> >& phi, vector<Mat<double> >& gamma, Mat<double>& a, DistriContainer<U>& lambda, Col<double>& perp, Col<uint32_t>& localIt, double omega, double kappa, uint32_t S, bool sameIndAsX=false)
     {
-      uint32_t d_0 = min(ind_x); // thats the doc number that we start with -> needed for ro computation; assumes that all indices in mX prior to d_0 have already been processed.
-      uint32_t D= max(ind_x)+1; // D is the maximal index of docs that we are processing +1
+      uint32_t d_0 = min(ind_x)+mDocsDiscarded; // thats the doc number that we start with -> needed for ro computation; assumes that all indices in mX prior to d_0 have already been processed.
+      uint32_t D= max(ind_x)+1+mDocsDiscarded; // D is the maximal index of docs that we are processing +1
 
       Row<uint32_t> ind = shuffle(ind_x,1);
 //        cout<<"ind_x: "<<ind_x.cols(0,S)<<endl;
@@ -321,18 +520,85 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
       phi.resize(ind.n_elem);
       gamma.resize(ind.n_elem,Mat<double>(mT,2));
       perp.zeros(ind.n_elem);
+      localIt.zeros(ind.n_elem);
+
+      // Dir topics are updated with sparse natural gradients which only touch 
+      // the words of the current minibatch (see DirTopicBank)
+      const Dir* dir = dynamic_cast<const Dir*>(&(HDP<U>::mH0));
+      bool sparse = (dir != NULL);
+      DirTopicBank bank;
+      Row<uint32_t> loc; // position of each word within the vocabulary of the minibatch
+      if (sparse)
+      {
+        bank.init(lambda, dir->mAlphas);
+        loc.set_size(bank.Nw());
+        loc.fill(NOT_IN_BATCH);
+      }
 
-      for (uint32_t dd=0; dd<ind.n_elem; dd += S)
+      if (mHogwild && sparse)
+      {
+        updateEst_hogwild(ind, zeta, phi, gamma, a, bank, localIt, omega, kappa, d_0, D, sameIndAsX);
+        bank.toContainer(lambda);
+        if (HDP<U>::mX_te.size() > 0) {
+          uint32_t dp = ind.n_elem-1; // held out perplexity at the end only
+          for (uint32_t i=0; i < HDP<U>::mX_te.size(); ++i)
+            perp[dp] += perplexity(HDP<U>::mX_te[i],HDP<U>::mX_ho[i],D,kappa);
+          perp[dp] /= double(HDP<U>::mX_te.size());
+          cout<<"Perplexity="<<perp[dp]<<endl;
+        }
+        return ind;
+      }
+
+      // In pipelined mode the global update (M-step) of minibatch t runs on a 
+      // separate thread while the doc level updates (E-step) of minibatch t+1 
+      // work on a snapshot of the globals taken after the M-step of t-1 
+      // -> the globals are at most one minibatch stale.
+      Mat<R> eLogBetaTab; // snapshot of the E[log beta] table; shared read-only by all threads
+      Col<R> eLogSig_a; // snapshot of E[log sigma(a)]
+      Col<uint32_t> words; // vocabulary of the minibatch
+      DistriContainer<U>* lambdaSnap = NULL; // snapshot of lambda if there is no table (pipelined mode only)
+      const DistriContainer<U>* lambdaE = &lambda; // lambda as seen by the E-step
+      BatchGrad grad; // natural gradients of the minibatch in the M-step
+      boost::thread mStepThread;
+
+      // per thread topics for the natural gradients of a doc and their sums 
+      // over the minibatch; allocated once and reused (dense updates only)
+      uint32_t P = numThreads();
+      vector<DistriContainer<U> > d_lambdaT(P);
+      vector<DistriContainer<U> > dbH_lambda(P);
+      if (!sparse)
       {
-        DistriContainer<U> db_lambda(HDP<U>::mH0,mK);
+        for (uint32_t p=0; p<P; ++p)
+        {
+          d_lambdaT[p].init(HDP<U>::mH0,mK);
+          dbH_lambda[p].init(HDP<U>::mH0,mK);
+        }
+        grad.dH_lambda.init(HDP<U>::mH0,mK);
+      }
 
-        Mat<double> db_a(mK,2); 
-        db_a.zeros();
+      snapshotGlobals(words, eLogBetaTab, eLogSig_a, loc, ind, 0, min(S,ind.n_elem), bank, a, lambda);
+      for (uint32_t dd=0; dd<ind.n_elem; dd += S)
+      {
+        uint32_t bS = min(S,ind.n_elem-dd); // necessary for the last batch, which migth not form a complete batch
 
-        Col<double> eLogSig_a(mK);
-        compElogSig(eLogSig_a, a);
+        // per thread accumulators for the natural gradients of this batch
+        vector<Mat<double> > db_lambda(P); // sparse updates
+        vector<Mat<double> > db_a(P); 
+        if (!sparse)
+          for (uint32_t p=0; p<P; ++p)
+            for (uint32_t k=0; k<mK; ++k)
+              dbH_lambda[p][k]->zero();
 
-#pragma omp parallel for schedule(dynamic) 
+#pragma omp parallel
+        {
+        uint32_t p = threadId();
+        if (sparse)
+          db_lambda[p].zeros(mK,words.n_elem);
+        db_a[p].zeros(mK,2);
+        DistriContainer<U>& d_lambda = d_lambdaT[p]; 
+        Mat<double> d_a(mK,2); 
+
+#pragma omp for schedule(dynamic) 
         for (uint32_t db=dd; db<min(dd+S,ind.n_elem); db++)
         {
           uint32_t d=ind[db];  
@@ -343,121 +609,90 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
 
           cout<<"-- db="<<db<<" d="<<d<<" N="<<N<<endl;
 
-          Mat<double> eLogBeta(mK,x_d.n_cols);
-          Col<double> digam_lamb_sum(mK);
-          compElogBeta(eLogBeta, lambda, x_d);
-
-          //Mat<double> zeta(T,K);
-          phi[dout].resize(N,mT);
-          initZeta(zeta[dout],eLogBeta);
-          initPhi(phi[dout],zeta[dout],eLogBeta);
-
-//            cout<<"zeta_init="<<zeta[dout]<<endl;
-//            cout<<"phi_init="<<phi[dout]<<endl;
-//            cout<<"eLogBeta="<<eLogBeta<<endl;
-//            if(!is_finite(zeta[dout]))
-//              exit(0);
-
-          //cout<<" ------------------------ doc level updates --------------------"<<endl;
-          //Mat<double> gamma(T,2);
-          Col<double> eLogSig_gam(mT);
-          Mat<double> gamma_prev(mT,2);
-          gamma_prev.ones();
-          gamma_prev.col(1) += HDP<U>::mAlpha;
-          bool converged = false;
-          uint32_t o=0;
-          while(!converged){
-//            cout<<"-------------- Iterating local params #"<<o<<" -------------------------"<<endl;
-            updateGamma(gamma[dout],phi[dout]);
-
-            if (!is_finite(gamma[dout])){
-              cout<<"gamma="<<gamma[dout];
-              cout<<"phi="<<phi[dout];
-              exit(1);
-            }
-
-            compElogSig(eLogSig_gam,gamma[dout]); // precompute 
+          Mat<R> eLogBeta(mK,x_d.n_cols);
+          compElogBeta(eLogBeta, *lambdaE, x_d, eLogBetaTab, loc);
+          Col<double> w; // counts for each column of x_d
+          HDP<U>::mH0.counts(x_d,w);
+          Col<R> w_r = conv_to<Col<R> >::from(w);
 
-            updateZeta(zeta[dout],phi[dout],eLogSig_a,eLogBeta);
-            updatePhi(phi[dout],zeta[dout],eLogSig_gam,eLogBeta);
+          Mat<R> zeta_d(mT,mK); // local parameters in compute precision
+          Mat<R> phi_d(N,mT);
+          localIt[dout] = localUpdate(zeta_d, phi_d, gamma[dout], eLogBeta, w_r, eLogSig_a);
+          zeta[dout] = conv_to<Mat<double> >::from(zeta_d);
+          phi[dout] = conv_to<Mat<double> >::from(phi_d);
 
-            converged = (accu(gamma_prev != gamma[dout]))==0 || o>30 ;
-            gamma_prev = gamma[dout];
-            ++o;
-
-//            cout<<"o="<<o<<endl;
-//            cout<<"zeta="<<zeta[dout].row(0)<<" |.|="<<sum(zeta[dout].row(0))<<endl;
-//            cout<<"phi="<<phi[dout].row(0)<<" |.|="<<sum(phi[dout].row(0))<<endl;
-//            if(!is_finite(zeta[dout]))
-//              exit(0);
-          }
-
-          DistriContainer<U> d_lambda(HDP<U>::mH0,mK); // batch updates
-          Mat<double> d_a(mK,2); 
 //          cout<<" --------------------- natural gradients dout="<< dout<<" dd="<< dd<<" --------------------------- "<<endl;
-          computeNaturalGradients(d_lambda, d_a, zeta[dout], phi[dout], HDP<U>::mOmega, D, x_d);
-#pragma omp critical
-          {
-            cout<<"update_batch::d_lambda:"<<endl<<d_lambda.toMat().rows(0,5);
-            for (uint32_t k=0; k<d_lambda.size(); ++k){
-              db_lambda[k]->fromRow(db_lambda[k]->asRow() + d_lambda[k]->asRow());
-            }
-            db_a += d_a;
+          if (sparse)
+          { // d lambda_kw = D sum_n [x_n==w] w_n sum_i phi(n,i) zeta(i,k) without the prior
+            Mat<double> phiZeta = conv_to<Mat<double> >::from(Mat<R>(phi_d*zeta_d));
+            for (uint32_t n=0; n<N; ++n)
+              db_lambda[p].col(loc(uint32_t(x_d(0,n)))) += (D*w(n))*phiZeta.row(n).t();
+            computeNaturalGradientA(d_a, zeta[dout], HDP<U>::mOmega, D);
+          }else{
+            for (uint32_t k=0; k<mK; ++k) 
+              d_lambda[k]->axpy(1.0, HDP<U>::mH0, 0.0); // reset to the prior
+            computeNaturalGradients(d_lambda, d_a, zeta[dout], phi[dout], HDP<U>::mOmega, D, x_d);
+            for (uint32_t k=0; k<mK; ++k)
+              dbH_lambda[p][k]->axpy(1.0, *d_lambda[k]);
           }
+          db_a[p] += d_a;
+        }
         }
+        if (sparse)
+          reduceTree(db_lambda);
+        else
+          reduceTree(dbH_lambda);
+        reduceTree(db_a);
+        if (sparse)
+          for (uint32_t j=0; j<words.n_elem; ++j)
+            loc(words(j)) = NOT_IN_BATCH;
         //for (uint32_t k=0; k<K; ++k)
         //  cout<<"delta lambda_"<<k<<" min="<<min(d_lambda.row(k))<<" max="<< max(d_lambda.row(k))<<" #greater 0.1="<<sum(d_lambda.row(k)>0.1)<<endl;
+        uint32_t itSum=0, itMax=0;
+        for (uint32_t db=dd; db<dd+bS; db++)
+        {
+          uint32_t o=localIt[sameIndAsX?ind[db]:db];
+          itSum += o; itMax = max(itMax,o);
+        }
+        cout<<"-- local iterations: mean="<<double(itSum)/double(bS)<<" max="<<itMax<<endl;
+
         // ----------------------- update global params -----------------------
+        if (mStepThread.joinable()) mStepThread.join(); // M-step of the previous minibatch
         uint32_t t=dd+d_0; // d_0 is the timestep of the the first index to process; dd is the index in the current batch
-        uint32_t bS = min(S,ind.n_elem-dd); // necessary for the last batch, which migth not form a complete batch
         //TODO: what is the time dd? d_0 needed?
-        double ro = exp(-kappa*log(1+double(t)+double(bS)/2.0)); // as "time" use the middle of the batch 
-//        cout<<" -- global parameter updates t="<<t<<" bS="<<bS<<" ro="<<ro<<endl;
-//        cout<<"d_a="<<db_a<<endl;
-        
-
-//        cout<<"dLambda"<<endl;
-//        for (uint32_t k=0; k<10; ++k)
-//          cout<<db_lambda[k]->asRow();
-//        
-//        cout<<"Before"<<endl;
-//        for (uint32_t k=0; k<10; ++k)
-//          cout<<lambda[k]->asRow();
-
-        cout<<"update_batch::db_lambda:"<<endl<<db_lambda.toMat().rows(0,5);
-        for (uint32_t k=0; k<db_lambda.size(); ++k)
-          lambda[k]->fromRow((1.0-ro)*lambda[k]->asRow() + (ro/S)*db_lambda[k]->asRow()); //TODO: doies this make sense for NIW prior???
-        cout<<"update_batch::lambda(after):"<<endl<<lambda.toMat().rows(0,5);
-
-//        cout<<"After"<<endl;
-//        for (uint32_t k=0; k<10; ++k)
-//          cout<<lambda[k]->asRow();
-
-
-        //lambda = (1.0-ro)*lambda + (ro/S)*db_lambda;
-        a = (1.0-ro)*a + (ro/S)*db_a;
-        cout<<"update_batch::lambda:"<<lambda.toMat().rows(0,5);
-
-        perp[dd+bS/2] = 0.0;
-        if (HDP<U>::mX_te.size() > 0) {
-          cout<<"computing "<<HDP<U>::mX_te.size()<<" perplexities"<<endl;
-#pragma omp parallel for schedule(dynamic) 
-          for (uint32_t i=0; i < HDP<U>::mX_te.size(); ++i)
+        grad.dd = dd;
+        grad.bS = bS;
+        grad.ro = exp(-kappa*log(1+double(t)+double(bS)/2.0)); // as "time" use the middle of the batch 
+        grad.words.swap(words);
+        if (sparse)
+          grad.d_lambda.swap(db_lambda[0]);
+        else
+          grad.dH_lambda.swap(dbH_lambda[0]); // the previous gradient becomes the accumulator
+        grad.d_a.swap(db_a[0]);
+        if (mPipelined)
+        {
+          if (dd+S < ind.n_elem) // snapshot for the next E-step before the globals change
           {
-            //cout<<"mX_te: "<< mX_te[i].n_rows << "x"<< mX_te[i].n_cols<<endl;
-            //cout<<"mX_ho: "<< mX_ho[i].n_rows << "x"<< mX_ho[i].n_cols<<endl;
-            //TODO: these subfunctions work on the member variables!!! dont do that...
-            double perp_i =  perplexity(HDP<U>::mX_te[i],HDP<U>::mX_ho[i],dd+bS/2+1,ro); //perplexity(mX_ho[i], mZeta[d], mPhi[d], mGamma[d], lambda);
-            //cout<<"perp_"<<i<<"="<<perp_i<<endl;
-#pragma omp critical
-            {
-              perp[dd+bS/2] += perp_i;
+            snapshotGlobals(words, eLogBetaTab, eLogSig_a, loc, ind, dd+S, min(S,ind.n_elem-dd-S), bank, a, lambda);
+            if (eLogBetaTab.n_elem == 0)
+            { // E[log beta] is computed from lambda on the fly -> needs its own copy
+              delete lambdaSnap;
+              lambdaSnap = new DistriContainer<U>(lambda);
+              lambdaE = lambdaSnap;
             }
           }
-          perp[dd+bS/2] /= double(HDP<U>::mX_te.size());
-          cout<<"Perplexity="<<perp[dd+bS/2]<<endl;
+          mStepThread = boost::thread(boost::bind(&HDP_var<U,R,H>::globalUpdate, this, 
+                boost::cref(grad), sparse, boost::ref(bank), boost::ref(a), boost::ref(lambda), boost::ref(perp), S));
+        }else{
+          globalUpdate(grad, sparse, bank, a, lambda, perp, S);
+          if (dd+S < ind.n_elem)
+            snapshotGlobals(words, eLogBetaTab, eLogSig_a, loc, ind, dd+S, min(S,ind.n_elem-dd-S), bank, a, lambda);
         }
       }
+      if (mStepThread.joinable()) mStepThread.join();
+      delete lambdaSnap;
+      if (sparse)
+        bank.toContainer(lambda);
       cout<<"perp="<<perp.t()<<endl;
       return ind;
     };
@@ -466,7 +701,7 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
     // compute the perplexity of a given document split into x_test (to find a topic model for the doc) and x_ho (to evaluate the perplexity)
     double perplexity(const Mat<U>& x_te, const Mat<U>& x_ho, uint32_t d, double kappa=0.75)
     {
-      if (HDP<U>::mX.size() > 0 && HDP<U>::mX.size() == mPhi.size()) { // this should indicate that there exists a estimate already
+      if (HDP<U>::mLambda.size() > 0 && mA.n_rows > 0) { // the corpus level parameters have been estimated
        
         uint32_t N = x_te.n_cols;
         uint32_t T = mT; 
@@ -477,23 +712,31 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
         Mat<double> gamma(T,2);
         //uint32_t d = mX.size()-1;
 
-        Mat<double> a(mA);// DONE: make deep copy here!
-
-        DistriContainer<U> lambda(HDP<U>::mLambda);
-        double omega = HDP<U>::mOmega;
-
-
-        cout<<"perplexity::lambda:"<<lambda.toMat().rows(0,5);
-        cout<<"perplexity::mLambda:"<<HDP<U>::mLambda.toMat().rows(0,5);
-
-        cout<<"updating copied model with x"<<endl;
-        updateEst(x_te,zeta,phi,gamma,a,lambda,omega,d,kappa);
-//        cout<<" lambda.shape="<<lambda.size()<<endl;
+        updateLocal(x_te,zeta,phi,gamma,mA,HDP<U>::mLambda);
+
+        // global update of updateEst() with x_te; only the topics the doc is
+        // assigned to enter its mixture -> just these are copied and updated
+        Col<double> pi;
+        Col<double> sigPi;
+        Col<uint32_t> c;
+        getDocTopics(pi,sigPi,c,gamma,zeta);
+        Col<uint32_t> c_u = unique(c);
+        DistriContainer<U> lambda(K); // NULL for the other topics
+        double ro = exp(-kappa*log(1+double(d+1)));
+        for (uint32_t i=0; i<c_u.n_elem; ++i)
+        {
+          uint32_t k = c_u(i);
+          BaseMeasure<U>* d_lambda = HDP<U>::mH0.getCopy();
+          d_lambda->posteriorHDP_var(zeta.col(k),phi,d+1,x_te);
+          lambda[k] = HDP<U>::mLambda[k]->getCopy();
+          lambda[k]->axpy(ro, *d_lambda, 1.0-ro);
+          delete d_lambda;
+        }
         cout<<"computing perplexity under updated model"<<endl;
         //TODO: compute probabilities then use that to compute perplexity
 
         cout<<"x_te: "<<size(x_te);
-        Mixture<U> mix = docMixture(phi, zeta, gamma, lambda);
+        Mixture<U,typename H::ModeType> mix = docMixture(phi, zeta, gamma, lambda);
         return HDP<U>::perplexity(x_ho, mix);
         //return perplexity(x_ho, zeta, phi, gamma, lambda);
       }else{
@@ -501,10 +744,11 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
       }
     };
 
-    Mixture<U> docMixture(uint32_t d) const {
+    Mixture<U,typename H::ModeType> docMixture(uint32_t d) const {
       return docMixture(mPhi[d],mZeta[d],mGamma[d],HDP<U>::mLambda);
     };
-    Mixture<U> docMixture(const Mat<double>& phi, const Mat<double>& zeta, const Mat<double>& gamma, const DistriContainer<U>& lambda) const
+    // only the topics the doc is assigned to are read from lambda (see perplexity())
+    Mixture<U,typename H::ModeType> docMixture(const Mat<double>& phi, const Mat<double>& zeta, const Mat<double>& gamma, const DistriContainer<U>& lambda) const
     {
       Col<double> pi;
       Col<double> sigPi;
@@ -517,20 +761,15 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
       //cout<<"getWordTopics done"<<endl;
       //cout<<"z="<<z.t()<<size(z);
 
-      DistriContainer<U> beta;
-      HDP<U>::getCorpTopics(beta,lambda);
-//      cout<<"getCorpTopics done"<<endl;
-      //cout<<"beta:\t"<<size(beta);
-
       Col<uint32_t> c_u = unique(c);
       Row<double> ps(c_u.n_elem); // proportions in  the mixture
-      DistriContainer<U> beta_d(c_u.n_elem);
+      DistriContainer<U> beta_d(c_u.n_elem); // corpus level topics of the doc
       for (uint32_t i=0; i< c_u.n_elem; ++i){
-        beta_d[i] = beta[c_u(i)]->getCopy();
+        beta_d[i] = lambda[c_u(i)]->mode();
         ps[i] = sum(sigPi.elem(find(c == c_u(i) )));
       }
 //      cout<<"Mixture done"<<endl;
-      return Mixture<U>(beta_d,ps);
+      return Mixture<U,typename H::ModeType>(beta_d,ps);
     };
 
     /* Probability distribution over the words in document d
@@ -584,228 +823,411 @@ class HDP_var: public HDP<U>, public virtual HDP_var_base
 
   protected:
 
+    static const uint32_t NOT_IN_BATCH = 0xFFFFFFFF; // marks words that are not in the vocabulary of a minibatch
+
     Row<uint32_t> mInd2Proc; // indices of docs that have not been processed
 
   private:
 
     /*
-     * precompute necessary digamma function values, because these are slowing the whole algorithm down
-     * all the update methods for zeta and phi need these values very often! I can precumpute these once after updating the global parameters (and hence lambda)
+     * doc level updates of zeta, phi and gamma until convergence 
+     * (see setLocalConvergence())
+     * @return number of iterations
      */
-    void compElogBeta(Mat<double>& eLogBeta, const DistriContainer<U>& lambda, const Mat<U>& x_d) const 
-    { 
-      eLogBeta.zeros(mK,x_d.n_cols);
-
-      Col<double> digam_lamb_sum(mK);
-    //  Mat<uint32_t> x_u = unique(x_d); // cannot do this trick anymore since x_d are continuous for the NIW base measure
-//      cout<<"x_d="<<x_d<<endl;
-//      cout<<"x_u="<<x_u<<endl;
- 
-      for (uint32_t i = 0; i < x_d.n_cols ; i++) {
-        for (uint32_t k = 0; k < mK; k++) {
-           eLogBeta(k,i) = lambda[k]->Elog(x_d.col(i)); // E[log beta] computation in paper
+    uint32_t localUpdate(Mat<R>& zeta_d, Mat<R>& phi_d, Mat<double>& gamma, const Mat<R>& eLogBeta, 
+        const Col<R>& w_r, const Col<R>& eLogSig_a)
+    {
+      initZeta(zeta_d,eLogBeta,w_r);
+      initPhi(phi_d,zeta_d,eLogBeta);
+
+//            cout<<"zeta_init="<<zeta_d<<endl;
+//            cout<<"phi_init="<<phi_d<<endl;
+//            cout<<"eLogBeta="<<eLogBeta<<endl;
+
+      Col<double> eLogSig_gam(mT);
+      Mat<double> gamma_prev(mT,2);
+      gamma_prev.ones();
+      gamma_prev.col(1) += HDP<U>::mAlpha;
+      bool converged = false;
+      uint32_t o=0;
+      while(!converged){
+//        cout<<"-------------- Iterating local params #"<<o<<" -------------------------"<<endl;
+        updateGammaElogSig(gamma,eLogSig_gam,phi_d,w_r,HDP<U>::mAlpha);
+
+        if (!is_finite(gamma)){
+          cout<<"gamma="<<gamma;
+          cout<<"phi="<<phi_d;
+          exit(1);
         }
+
+        updateZeta(zeta_d,phi_d,eLogSig_a,eLogBeta,w_r);
+        updatePhi(phi_d,zeta_d,conv_to<Col<R> >::from(eLogSig_gam),eLogBeta);
+
+        converged = localConverged(gamma_prev,gamma,o);
+        gamma_prev = gamma;
+        ++o;
       }
-//      for (uint32_t k = 0; k < mK; k++) {
-//        digam_lamb_sum(k) = digamma(sum(lambda.row(k)));
-//      }
-//      for (uint32_t i = 0; i < x_u.n_elem ; i++) {
-//        for (uint32_t k = 0; k < mK; k++) {
-//           eLogBeta(k,x_u(i)) = digamma(lambda(k,x_u(i))) - digam_lamb_sum(k);
-//        }
-//      }
-    }
+      return o;
+    };
 
-    void compElogSig(Col<double>& eLogSig, const Mat<double>& a) const
+    /*
+     * Hogwild updates for Dir topics: every doc is processed on its own and 
+     * its natural gradient is applied right away (with the step size of its
+     * own time step) to the shared topic bank. There is no barrier between
+     * docs and no lock on the topics (see DirTopicBank::updateHogwild()); 
+     * the small K x 2 stick parameters a are updated under a lock.
+     */
+    void updateEst_hogwild(const Row<uint32_t>& ind, vector<Mat<double> >& zeta, vector<Mat<double> >& phi, 
+        vector<Mat<double> >& gamma, Mat<double>& a, DirTopicBank& bank, Col<uint32_t>& localIt, 
+        double omega, double kappa, uint32_t d_0, uint32_t D, bool sameIndAsX)
     {
-      for (uint32_t k=0; k<a.n_rows; ++k){
-        eLogSig(k) = digamma(a(k,0)) - digamma(a(k,0) + a(k,1));
-        for (uint32_t l=0; l<k; ++l)
-          eLogSig(k) += digamma(a(l,1)) - digamma(a(l,0) + a(l,1));
+      uint32_t t_shared = 0; // number of docs that have been processed
+#pragma omp parallel for schedule(dynamic) 
+      for (uint32_t db=0; db<ind.n_elem; db++)
+      {
+        uint32_t d=ind[db];  
+        const Mat<U>& x_d = HDP<U>::mX[d];
+        uint32_t dout=sameIndAsX?d:db;
+        uint32_t N=x_d.n_cols;
+
+        // vocabulary of the doc and the column of each word in it
+        Col<uint32_t> words = unique(conv_to<Col<uint32_t> >::from(x_d.row(0)));
+        Col<uint32_t> col(N);
+        for (uint32_t n=0; n<N; ++n)
+          col(n) = lower_bound(words.begin(),words.end(),uint32_t(x_d(0,n))) - words.begin();
+
+        Mat<R> tab;
+        bank.ElogTable(words, tab); // reads the shared topics without a lock
+        Mat<R> eLogBeta(mK,N);
+        for (uint32_t n=0; n<N; ++n)
+          eLogBeta.col(n) = tab.col(col(n));
+        Col<double> w; // counts for each column of x_d
+        HDP<U>::mH0.counts(x_d,w);
+        Col<R> w_r = conv_to<Col<R> >::from(w);
+
+        Mat<double> a_d;
+#pragma omp critical (hogwild_a)
+        a_d = a;
+        Col<double> eLogSig_a_d(mK);
+        compElogSig(eLogSig_a_d, a_d);
+        Col<R> eLogSig_a = conv_to<Col<R> >::from(eLogSig_a_d);
+
+        Mat<R> zeta_d(mT,mK); 
+        Mat<R> phi_d(N,mT);
+        localIt[dout] = localUpdate(zeta_d, phi_d, gamma[dout], eLogBeta, w_r, eLogSig_a);
+        zeta[dout] = conv_to<Mat<double> >::from(zeta_d);
+        phi[dout] = conv_to<Mat<double> >::from(phi_d);
+
+        // natural gradients of this doc
+        Mat<double> phiZeta = conv_to<Mat<double> >::from(Mat<R>(phi_d*zeta_d));
+        Mat<double> d_lambda(mK,words.n_elem);
+        d_lambda.zeros();
+        for (uint32_t n=0; n<N; ++n)
+          d_lambda.col(col(n)) += (D*w(n))*phiZeta.row(n).t();
+        Mat<double> d_a(mK,2); 
+        computeNaturalGradientA(d_a, zeta[dout], omega, D);
+
+        uint32_t t;
+#pragma omp atomic capture
+        t = t_shared++;
+        double ro = exp(-kappa*log(1+double(t+d_0)));
+        bank.updateHogwild(words, d_lambda, ro);
+#pragma omp critical (hogwild_a)
+        a = (1.0-ro)*a + ro*d_a;
       }
-    }
+    };
 
-    void initZeta(Mat<double>& zeta, const Mat<double>& eLogBeta)
+    /*
+     * worker p of densityEstDistributed(): processes the docs p, p+P, p+2P, ...
+     * of x in minibatches of S
+     */
+    bool workerLoop(DirParamClient& ps, const vector<Mat<U> >& x, uint32_t p, uint32_t P, uint32_t S)
     {
-      uint32_t N = eLogBeta.n_cols; // x_d.n_cols;
-      uint32_t T = zeta.n_rows;
-      uint32_t K = zeta.n_cols;
-      //cerr<<"\tinit zeta"<<endl;
-      for (uint32_t i=0; i<T; ++i) {
-        for (uint32_t k=0; k<K; ++k) {
-          zeta(i,k)=0.0;
-          for (uint32_t n=0; n<N; ++n) {
-            //if(i==0 && k==0) cout<<zeta(i,k)<<" -> ";
-            zeta(i,k) += eLogBeta(k,n); //ElogBeta(lambda, k, x_d(n));
-          }
+      uint32_t D = x.size();
+      Row<uint32_t> shard; 
+      if (p < D) 
+        shard = linspace<Row<uint32_t> >(p, p+P*((D-1-p)/P), (D-1-p)/P+1);
+      Row<uint32_t> loc(mNw);
+      loc.fill(NOT_IN_BATCH);
+      for (uint32_t dd=0; dd<shard.n_elem; dd += S)
+      {
+        uint32_t bS = min(S,shard.n_elem-dd);
+        Col<uint32_t> words;
+        batchVocabulary(words, loc, x, shard, dd, dd+bS);
+        Mat<double> tab, a;
+        if (!ps.pull(words, tab, a)) return false;
+        Mat<R> eLogBetaTab = conv_to<Mat<R> >::from(tab);
+        Col<double> eLogSig_a_d(mK);
+        compElogSig(eLogSig_a_d, a);
+        Col<R> eLogSig_a = conv_to<Col<R> >::from(eLogSig_a_d);
+
+        Mat<double> dLambda(mK,words.n_elem);
+        dLambda.zeros();
+        Mat<double> da(mK,2);
+        da.zeros();
+        for (uint32_t db=dd; db<dd+bS; ++db)
+        {
+          const Mat<U>& x_d = x[shard[db]];
+          uint32_t N = x_d.n_cols;
+          Mat<R> eLogBeta(mK,N);
+          compElogBeta(eLogBeta, HDP<U>::mLambda, x_d, eLogBetaTab, loc);
+          Col<double> w; // counts for each column of x_d
+          HDP<U>::mH0.counts(x_d,w);
+          Col<R> w_r = conv_to<Col<R> >::from(w);
+
+          Mat<R> zeta_d(mT,mK); 
+          Mat<R> phi_d(N,mT);
+          Mat<double> gamma(mT,2);
+          localUpdate(zeta_d, phi_d, gamma, eLogBeta, w_r, eLogSig_a);
+
+          Mat<double> phiZeta = conv_to<Mat<double> >::from(Mat<R>(phi_d*zeta_d));
+          for (uint32_t n=0; n<N; ++n)
+            dLambda.col(loc(uint32_t(x_d(0,n)))) += (D*w(n))*phiZeta.row(n).t();
+          Mat<double> d_a(mK,2);
+          computeNaturalGradientA(d_a, conv_to<Mat<double> >::from(zeta_d), HDP<U>::mOmega, D);
+          da += d_a;
         }
-        normalizeLogDistribution(zeta.row(i));
-        //cout<<" normalized="<<zeta(0,0)<<endl;
+        for (uint32_t j=0; j<words.n_elem; ++j)
+          loc(words(j)) = NOT_IN_BATCH;
+        if (!ps.push(words, dLambda, da, bS)) return false;
       }
-      //cerr<<"zeta>"<<endl<<zeta<<"<zeta"<<endl;
-      //cerr<<"normalization check:"<<endl<<sum(zeta,1).t()<<endl; // sum over rows
+      return true;
     };
 
-    void initPhi(Mat<double>& phi, const Mat<double>& zeta, const Mat<double>& eLogBeta)
+    using HDP_var_base::reduceTree;
+
+    // reduceTree() of per thread topic accumulators (see BaseMeasure::axpy())
+    static void reduceTree(vector<DistriContainer<U> >& acc)
     {
-      uint32_t N = phi.n_rows; // x_d.n_cols;
-      uint32_t T = zeta.n_rows;
-      uint32_t K = zeta.n_cols;
-      //cout<<"\tinit phi"<<endl;
-      for (uint32_t n=0; n<N; ++n){
-        for (uint32_t i=0; i<T; ++i) {
-          phi(n,i)=0.0;
-          for (uint32_t k=0; k<K; ++k) {
-            phi(n,i)+=zeta(i,k)* eLogBeta(k,n); // ElogBeta(lambda, k, x_d(n));
-          }
-        }
-        normalizeLogDistribution(phi.row(n));
+      int32_t P = acc.size();
+      for (int32_t s=1; s<P; s*=2)
+      {
+#pragma omp parallel for schedule(static)
+        for (int32_t p=0; p<P-s; p+=2*s)
+          for (uint32_t k=0; k<acc[p].size(); ++k)
+            acc[p][k]->axpy(1.0, *acc[p+s][k]);
       }
-      //cerr<<"phi>"<<endl<<phi<<"<phi"<<endl;
     };
 
-    void updateGamma(Mat<double>& gamma, const Mat<double>& phi)
+    // natural gradients of a minibatch for the global update
+    struct BatchGrad
     {
-      uint32_t N = phi.n_rows;
-      uint32_t T = phi.n_cols;
+      uint32_t dd; // index of the first doc of the minibatch
+      uint32_t bS; // size of the minibatch
+      double ro; // step size
+      Col<uint32_t> words; // vocabulary of the minibatch (sparse Dir updates only)
+      Mat<double> d_lambda; // K x words.n_elem (sparse Dir updates)
+      DistriContainer<U> dH_lambda; // K topics (dense updates)
+      Mat<double> d_a; // K x 2
+    };
 
-      gamma.ones();
-      gamma.col(1) *= HDP<U>::mAlpha;
-      for (uint32_t i=0; i<T; ++i) 
-      {
-        for (uint32_t n=0; n<N; ++n){
-          gamma(i,0) += phi(n,i);
-          for (uint32_t j=i+1; j<T; ++j) {
-            gamma(i,1) += phi(n,j);
-          }
-        }
-      }
-      //cout<<gamma.t()<<endl;
+    /*
+     * computes everything the doc level updates of the minibatch 
+     * ind[dd..dd+bS-1] need from the globals
+     */
+    void snapshotGlobals(Col<uint32_t>& words, Mat<R>& eLogBetaTab, Col<R>& eLogSig_a, Row<uint32_t>& loc, const Row<uint32_t>& ind, uint32_t dd, uint32_t bS, const DirTopicBank& bank, 
+        const Mat<double>& a, const DistriContainer<U>& lambda) const
+    {
+      if (loc.n_elem > 0)
+      { // sparse Dir updates
+        batchVocabulary(words, loc, HDP<U>::mX, ind, dd, dd+bS);
+        bank.ElogTable(words, eLogBetaTab); 
+      }else
+        compElogBetaTable(eLogBetaTab, lambda); // empty for NIW -> E[log beta] from lambda
+      Col<double> eLogSig_a_d(mK);
+      compElogSig(eLogSig_a_d, a);
+      eLogSig_a = conv_to<Col<R> >::from(eLogSig_a_d);
     };
 
-    void updateZeta(Mat<double>& zeta, const Mat<double>& phi, const Col<double>& eLogSig_a, const Mat<double>& eLogBeta)
+    /*
+     * global update (M-step) of lambda and a with the natural gradients of 
+     * a minibatch; also evaluates the held out perplexity
+     */
+    void globalUpdate(const BatchGrad& grad, bool sparse, DirTopicBank& bank, Mat<double>& a, 
+        DistriContainer<U>& lambda, Col<double>& perp, uint32_t S)
     {
-//      assert(x_d.n_rows == 1);
+      uint32_t dd = grad.dd;
+      uint32_t bS = grad.bS;
+      double ro = grad.ro;
+//        cout<<" -- global parameter updates t="<<t<<" bS="<<bS<<" ro="<<ro<<endl;
 
-      uint32_t N = phi.n_rows; // x_d.n_cols;
-      uint32_t T = zeta.n_rows;
-      uint32_t K = zeta.n_cols;
+      if (sparse)
+      {
+        bank.update(grad.words, grad.d_lambda/S, ro);
+        if (HDP<U>::mX_te.size() > 0) 
+          bank.toContainer(lambda); // the held out evaluation below works on lambda
+      }else{
+        for (uint32_t k=0; k<mK; ++k)
+        {
+          lambda[k]->axpy(ro/S, *grad.dH_lambda[k], 1.0-ro); //TODO: doies this make sense for NIW prior???
+          lambda[k]->refresh(); // before the next E-step reads lambda from all threads
+        }
+        cout<<"update_batch::lambda(after):"<<endl<<lambda.toMat().rows(0,5);
+      }
 
-      for (uint32_t i=0; i<T; ++i){
-        //zeta(i,k)=0.0;
-        for (uint32_t k=0; k<K; ++k) {
-          zeta(i,k) = eLogSig_a(k); //ElogSigma(a,k);
-          //cout<<zeta(i,k)<<endl;
-          for (uint32_t n=0; n<N; ++n){
-            zeta(i,k) += phi(n,i)* eLogBeta(k,n); //ElogBeta(lambda,k,x_d(n));
+      //lambda = (1.0-ro)*lambda + (ro/S)*db_lambda;
+      a = (1.0-ro)*a + (ro/S)*grad.d_a;
+
+      perp[dd+bS/2] = 0.0;
+      if (HDP<U>::mX_te.size() > 0) {
+        cout<<"computing "<<HDP<U>::mX_te.size()<<" perplexities"<<endl;
+#pragma omp parallel for schedule(dynamic) 
+        for (uint32_t i=0; i < HDP<U>::mX_te.size(); ++i)
+        {
+          //TODO: these subfunctions work on the member variables!!! dont do that...
+          double perp_i =  perplexity(HDP<U>::mX_te[i],HDP<U>::mX_ho[i],dd+bS/2+1,ro); //perplexity(mX_ho[i], mZeta[d], mPhi[d], mGamma[d], lambda);
+          //cout<<"perp_"<<i<<"="<<perp_i<<endl;
+#pragma omp critical
+          {
+            perp[dd+bS/2] += perp_i;
           }
         }
-        normalizeLogDistribution(zeta.row(i));
+        perp[dd+bS/2] /= double(HDP<U>::mX_te.size());
+        cout<<"Perplexity="<<perp[dd+bS/2]<<endl;
       }
-    }
-
+    };
 
-    void updatePhi(Mat<double>& phi, const Mat<double>& zeta, const Col<double>& eLogSig_gam, const Mat<double>& eLogBeta)
+    // streaming mode: drop the processed docs; their indices continue at mDocsDiscarded
+    void discardDocs()
     {
-//      assert(x_d.n_rows == 1);
+      mDocsDiscarded += HDP<U>::mX.size();
+      vector<Mat<U> >().swap(HDP<U>::mX);
+    };
 
-      uint32_t N = phi.n_rows; // x_d.n_cols;
-      uint32_t T = zeta.n_rows;
-      uint32_t K = zeta.n_cols;
+    /*
+     * precompute E[log beta] for all K topics over the whole (finite) support of 
+     * the base measure - for Dir these are the digamma values for all Nw words.
+     * This is done once after each global update and then shared read-only by 
+     * all doc level updates instead of recomputing 2*K*N digammas per document.
+     * @return false if the base measure has no finite support (NIW) -> table is empty
+     */
+    template<class V>
+    bool compElogBetaTable(Mat<V>& eLogBetaTab, const DistriContainer<U>& lambda) const
+    {
+      Row<double> eLog;
+      if (lambda.size() == 0 || !lambda[0]->ElogTable(eLog))
+      {
+        eLogBetaTab.set_size(0,0);
+        return false;
+      }
+      eLogBetaTab.set_size(lambda.size(),eLog.n_elem);
+      eLogBetaTab.row(0) = conv_to<Row<V> >::from(eLog);
+#pragma omp parallel for schedule(dynamic) 
+      for (uint32_t k=1; k<lambda.size(); ++k)
+      {
+        Row<double> eLog_k;
+        lambda[k]->ElogTable(eLog_k);
+        eLogBetaTab.row(k) = conv_to<Row<V> >::from(eLog_k);
+      }
+      return true;
+    }
 
-      for (uint32_t n=0; n<N; ++n){
-        //phi(n,i)=0.0;
-        for (uint32_t i=0; i<T; ++i) {
-          phi(n,i) = eLogSig_gam(i); //ElogSigma(gamma,i);
-          for (uint32_t k=0; k<K; ++k) {
-            phi(n,i) += zeta(i,k)* eLogBeta(k,n); //ElogBeta(lambda,k,x_d(n)) ;
-          }
+    /*
+     * precompute necessary digamma function values, because these are slowing the whole algorithm down
+     * all the update methods for zeta and phi need these values very often! I can precumpute these once after updating the global parameters (and hence lambda)
+     * @param eLogBetaTab table from compElogBetaTable(); if it is empty E[log beta] is evaluated for every x_d
+     * @param loc column of each word in eLogBetaTab; if it is empty column w holds word w
+     */
+    template<class V>
+    void compElogBeta(Mat<V>& eLogBeta, const DistriContainer<U>& lambda, const Mat<U>& x_d, const Mat<V>& eLogBetaTab, 
+        const Row<uint32_t>& loc=Row<uint32_t>()) const 
+    { 
+      eLogBeta.set_size(mK,x_d.n_cols);
+      if (eLogBetaTab.n_elem > 0 && loc.n_elem > 0)
+      { // x_d are word indices -> just gather the columns of the table
+        for (uint32_t i = 0; i < x_d.n_cols ; i++)
+          eLogBeta.col(i) = eLogBetaTab.col(loc(uint32_t(x_d(0,i))));
+      }else if (eLogBetaTab.n_elem > 0)
+      { 
+        for (uint32_t i = 0; i < x_d.n_cols ; i++)
+          eLogBeta.col(i) = eLogBetaTab.col(uint32_t(x_d(0,i)));
+      }else{
+        Row<double> eLog;
+        for (uint32_t k = 0; k < mK; k++) {
+          Measure<U,H>::ElogBatch(*lambda[k],x_d,eLog); // E[log beta] computation in paper
+          eLogBeta.row(k) = conv_to<Row<V> >::from(eLog);
         }
-        normalizeLogDistribution(phi.row(n));
       }
     }
 
-    void computeNaturalGradients(DistriContainer<U>& d_lambda, Mat<double>& d_a, const Mat<double>& zeta, const Mat<double>&  phi, double omega, uint32_t D, const Mat<U>& x_d)
+    /*
+     * collects the unique words of the docs x[ind[db0]] to x[ind[db1-1]] into 
+     * words and stores their position within words in loc (other entries of 
+     * loc have to be NOT_IN_BATCH)
+     */
+    void batchVocabulary(Col<uint32_t>& words, Row<uint32_t>& loc, const vector<Mat<U> >& x, const Row<uint32_t>& ind, uint32_t db0, uint32_t db1) const
     {
-//      uint32_t N = x_d.n_cols;
-//      uint32_t Nw = d_lambda.n_cols;
-      uint32_t T = zeta.n_rows;
-      uint32_t K = zeta.n_cols;
-
-//      d_lambda.init(HDP<U>::mH0,mK);
-
-//      d_lambda.zeros();
-      d_a.zeros();
-      for (uint32_t k=0; k<K; ++k) 
-      { // for all K corpus level topics
-//        cout<<zeta.col(k).t()<<endl;
-//        cout<<phi;
-        d_lambda[k]->posteriorHDP_var(zeta.col(k),phi,D,x_d);
-
-//        for (uint32_t i=0; i<T; ++i) 
-//        {
-//          Row<double> _lambda(Nw); _lambda.zeros();
-//          for (uint32_t n=0; n<N; ++n){
-//            _lambda(x_d(n)) += phi(n,i);
-//          }
-//          d_lambda.row(k) += zeta(i,k) * _lambda;
-//        }
-//        d_lambda.row(k) = D*d_lambda.row(k);
-//        //cout<<"lambda-nu="<<d_lambda[k].t()<<endl;
-//        d_lambda.row(k) += ((Dir*)(&mH0))->mAlphas;
-//        //cout<<"lambda="<<d_lambda[k].t()<<endl;
-
-        for (uint32_t i=0; i<T; ++i) 
+      vector<uint32_t> w_b;
+      for (uint32_t db=db0; db<db1; ++db)
+      {
+        const Mat<U>& x_d = x[ind[db]];
+        for (uint32_t i=0; i<x_d.n_cols; ++i)
         {
-          d_a(k,0) += zeta(i,k);
-          for (uint32_t l=k+1; l<K; ++l) {
-            d_a(k,1) += zeta(i,l);
+          uint32_t w = uint32_t(x_d(0,i));
+          if (loc(w) == NOT_IN_BATCH)
+          {
+            loc(w) = w_b.size();
+            w_b.push_back(w);
           }
         }
-        d_a(k,0) = D*d_a(k,0)+1.0;
-        d_a(k,1) = D*d_a(k,1)+omega;
       }
+      words = conv_to<Col<uint32_t> >::from(w_b);
     }
 
+    /*
+     * zeta(i,k) = sum_n w_n E[log beta_k(x_n)] for all doc level topics i -> one GEMV
+     * @param w counts of the columns of x_d (all ones unless x_d is in bag-of-words form)
+     */
+    template<class V>
+    void initZeta(Mat<V>& zeta, const Mat<V>& eLogBeta, const Col<V>& w) const
+    {
+      uint32_t T = zeta.n_rows;
+      zeta = repmat(trans(eLogBeta*w), T, 1);
+      normalizeLogDistributionRows(zeta);
+    };
 
-    //bool normalizeLogDistribution(Row<double>& r)
-    bool normalizeLogDistribution(arma::subview_row<double> r) const
+    /*
+     * phi(n,i) = sum_k zeta(i,k) E[log beta_k(x_n)] -> phi = eLogBeta^T * zeta^T as one GEMM
+     */
+    template<class V>
+    void initPhi(Mat<V>& phi, const Mat<V>& zeta, const Mat<V>& eLogBeta) const
     {
-      // known as the log sum exp trick!
-//      cout<<" r="<<r<<endl;
-      double maxR = as_scalar(max(r));
-//      cout<<"  maxR="<<maxR<<endl;
-//      cout<<"  exp(r-maxR)="<<exp(r-maxR)<<endl;
-     
-      r -= maxR + log(sum(exp(r-maxR)));
-      r=exp(r);
-
-//      cout<<" r="<<r<<endl;
-      return true;
+      phi = eLogBeta.t() * zeta.t();
+      normalizeLogDistributionRows(phi);
+    };
 
+    /*
+     * zeta(i,k) = E[log sigma_k(a)] + sum_n w_n phi(n,i) E[log beta_k(x_n)]
+     *  -> zeta = (diag(w) phi)^T eLogBeta^T as one GEMM
+     */
+    template<class V>
+    void updateZeta(Mat<V>& zeta, const Mat<V>& phi, const Col<V>& eLogSig_a, const Mat<V>& eLogBeta, const Col<V>& w) const
+    {
+      Mat<V> phiW(phi);
+      phiW.each_col() %= w;
+      zeta = phiW.t() * eLogBeta.t();
+      zeta.each_row() += eLogSig_a.t();
+      normalizeLogDistributionRows(zeta);
+    }
 
-//      double minR = as_scalar(min(r));
-//      cout<<" minR="<<minR<<endl;
-//      if(minR > -100.0) {
-//        cout<<" logDenom="<<sum(exp(r),1)<<endl;
-//        double denom = as_scalar(sum(exp(r),1));
-//        cout<<" logDenom="<<denom<<endl;
-//        r -= log(denom); // avoid division by 0
-//        cout<<" r - logDenom="<<r<<endl;
-//        r = exp(r);
-//        r /= sum(r);
-//        cout<<" exp(r - logDenom)="<<r<<endl;
-//        return true;
-//      }else{ // cannot compute this -> set the smallest r to 1.0 and the rest to 0
-//        double maxR = as_scalar(max(r));
-//        cout<<"maxR="<<maxR<<" <-" <<arma::max(r) <<endl;
-//        uint32_t kMax=as_scalar(find(r==maxR,1));
-//        cout<<"maxR="<<maxR<<" kMax="<<kMax<<" <-" <<arma::max(r) <<endl;
-//        r.zeros();
-//        r(kMax)=1.0;
-//        cout<<" r ="<<r<<endl;
-//        return false;
-//      }
+    /*
+     * phi(n,i) = E[log sigma_i(gamma)] + sum_k zeta(i,k) E[log beta_k(x_n)]
+     *  -> phi = eLogBeta^T zeta^T as one GEMM
+     */
+    template<class V>
+    void updatePhi(Mat<V>& phi, const Mat<V>& zeta, const Col<V>& eLogSig_gam, const Mat<V>& eLogBeta) const
+    {
+      phi = eLogBeta.t() * zeta.t();
+      phi.each_row() += eLogSig_gam.t();
+      normalizeLogDistributionRows(phi);
+    }
+
+    void computeNaturalGradients(DistriContainer<U>& d_lambda, Mat<double>& d_a, const Mat<double>& zeta, const Mat<double>&  phi, double omega, uint32_t D, const Mat<U>& x_d)
+    {
+      uint32_t K = zeta.n_cols;
+      for (uint32_t k=0; k<K; ++k) // for all K corpus level topics
+        d_lambda[k]->posteriorHDP_var(zeta.col(k),phi,D,x_d);
+      computeNaturalGradientA(d_a, zeta, omega, D);
     }
 
 };
@@ -12,6 +12,10 @@
 
 #include <armadillo>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace std;
 using namespace arma;
 
@@ -20,9 +24,75 @@ class HDP_var_base
   public:
     
     HDP_var_base(uint32_t K=0, uint32_t T=0, uint32_t Nw=0)
-      : mK(K), mT(T), mNw(Nw)
+      : mK(K), mT(T), mNw(Nw), mLocalTol(1e-3), mLocalMaxIt(100),
+      mStreaming(false), mKeepSummaries(false), mDocsDiscarded(0), mPipelined(false), mHogwild(false)
     {};
 
+    /*
+     * Hogwild mode (Dir base measure only): docs are processed one by one 
+     * in parallel and each applies its natural gradient to the shared 
+     * topics without locks instead of synchronizing in minibatches
+     */
+    void setHogwild(bool hogwild)
+    {
+      mHogwild = hogwild;
+    };
+
+    /*
+     * pipelined mode: the global update of a minibatch overlaps with the 
+     * doc level updates of the next one, which see globals that are at 
+     * most one minibatch stale
+     */
+    void setPipelined(bool pipelined)
+    {
+      mPipelined = pipelined;
+    };
+
+    /*
+     * In streaming mode the documents are processed in minibatches of S; 
+     * each minibatch and its local parameters are discarded once they have
+     * been used for the global update, so besides the model only one 
+     * minibatch is held (densityEst() of docs in memory also copies them in
+     * one minibatch at a time). With keepSummaries the most likely 
+     * corpus level topic of each document is kept (see getDocSummaries()).
+     */
+    void setStreaming(bool streaming, bool keepSummaries=false)
+    {
+      mStreaming = streaming;
+      mKeepSummaries = keepSummaries;
+    };
+
+    // number of documents that have been processed and discarded in streaming mode 
+    uint32_t getDocsDiscarded() const
+    {
+      return mDocsDiscarded;
+    };
+
+    /*
+     * most likely corpus level topic for each document that was processed 
+     * in streaming mode with keepSummaries (indexed by the global doc number)
+     */
+    void getDocSummaries(Col<uint32_t>& c) const
+    {
+      c = conv_to<Col<uint32_t> >::from(mDocTopic);
+    };
+
+    /*
+     * the doc level updates stop once the relative change of gamma 
+     * drops below tol or after maxIt iterations
+     */
+    void setLocalConvergence(double tol, uint32_t maxIt)
+    {
+      mLocalTol = tol;
+      mLocalMaxIt = max(maxIt,uint32_t(1));
+    };
+
+    // number of doc level iterations that were needed for each document
+    void getLocalIterations(Col<uint32_t>& it) const
+    {
+      it=mLocalIt;
+    };
+
     void getA(Mat<double>& a)
     {
       a=mA;
@@ -125,6 +195,44 @@ protected:
     uint32_t mT; // Doc level truncation
     uint32_t mNw; // size of dictionary
 
+    double mLocalTol; // tolerance on the relative change of gamma in the doc level updates
+    uint32_t mLocalMaxIt; // maximal number of doc level iterations
+    Col<uint32_t> mLocalIt; // number of doc level iterations for each document
+
+    bool mStreaming; // discard docs and local parameters after processing them
+    bool mKeepSummaries; // keep mDocTopic in streaming mode
+    uint32_t mDocsDiscarded; // number of docs that were discarded; offset of the doc indices
+    vector<uint32_t> mDocTopic; // most likely corpus level topic for each discarded doc
+
+    bool mPipelined; // overlap the global update with the doc level updates of the next minibatch
+    bool mHogwild; // lock free per doc updates of the topics 
+
+    /*
+     * stores the most likely corpus level topic of doc d: 
+     * argmax_k sum_i sigma_i(gamma) zeta(i,k)
+     */
+    void storeDocSummary(uint32_t d, const Mat<double>& gamma, const Mat<double>& zeta)
+    {
+      uint32_t T = gamma.n_rows;
+      Col<double> pi(T);
+      Col<double> sigPi(T+1);
+      betaMode(pi,gamma.col(0),gamma.col(1));
+      stickBreaking(sigPi,pi);
+      if (mDocTopic.size() <= d)
+        mDocTopic.resize(d+1,0);
+      mDocTopic[d] = multinomialMode(Row<double>(sigPi.rows(0,T-1).t()*zeta));
+    };
+
+    /*
+     * convergence test for the doc level updates after the o-th iteration.
+     * gamma is the sum over phi so it suffices to test the relative change
+     * |gamma-gamma_prev|_1/|gamma_prev|_1 of gamma.
+     */
+    bool localConverged(const Mat<double>& gamma_prev, const Mat<double>& gamma, uint32_t o) const
+    {
+      return (o+1 >= mLocalMaxIt) || 
+        (accu(abs(gamma-gamma_prev)) <= mLocalTol*accu(abs(gamma_prev)));
+    };
 
 
     /* 
@@ -163,6 +271,111 @@ protected:
     };
 
 
+    // number of threads available for the next parallel region (1 without OpenMP)
+    static uint32_t numThreads()
+    {
+#ifdef _OPENMP
+      return omp_get_max_threads();
+#else
+      return 1;
+#endif
+    };
+
+    // id of the calling thread within the current parallel region
+    static uint32_t threadId()
+    {
+#ifdef _OPENMP
+      return omp_get_thread_num();
+#else
+      return 0;
+#endif
+    };
+
+    /*
+     * sum up per thread accumulators into acc[0] as a parallel tree reduction;
+     * in step s thread accumulator p gets accumulator p+s added (log2(P) steps).
+     * Accumulators of threads that did not take part are empty and skipped.
+     */
+    static void reduceTree(vector<Mat<double> >& acc)
+    {
+      int32_t P = acc.size();
+      for (int32_t s=1; s<P; s*=2)
+      {
+#pragma omp parallel for schedule(static)
+        for (int32_t p=0; p<P-s; p+=2*s)
+        {
+          if (acc[p+s].n_elem == 0) 
+            continue;
+          if (acc[p].n_elem == 0)
+            acc[p] = acc[p+s];
+          else
+            acc[p] += acc[p+s];
+        }
+      }
+    };
+
+    /*
+     * Stick breaking kernels shared by the variational HDPs. All of them are 
+     * cumulative sums: E[log sigma_k] needs a prefix sum over the sticks l<k
+     * and gamma(i,1) as well as d_a(k,1) need suffix sums over j>i or l>k.
+     * Hence they cost O(N*T) resp. O(T*K) instead of O(N*T^2) resp. O(T*K^2).
+     */
+
+    /*
+     * E[log sigma_k(a)] = E[log v_k] + sum_{l<k} E[log (1-v_l)] with v_l ~ Beta(a(l,0),a(l,1))
+     */
+    static void compElogSig(Col<double>& eLogSig, const Mat<double>& a)
+    {
+      eLogSig.set_size(a.n_rows);
+      double eLog1mV = 0.0; // prefix sum of E[log (1-v_l)]
+      for (uint32_t k=0; k<a.n_rows; ++k){
+        double digam_a0 = digamma(a(k,0) + a(k,1));
+        eLogSig(k) = digamma(a(k,0)) - digam_a0 + eLog1mV;
+        eLog1mV += digamma(a(k,1)) - digam_a0;
+      }
+    };
+
+    /*
+     * doc level sticks gamma(i,0) = 1 + sum_n w_n phi(n,i), 
+     * gamma(i,1) = alpha + sum_n w_n sum_{j>i} phi(n,j) and their E[log sigma_i]
+     * in one pass over phi followed by a backward (suffix) and a forward 
+     * (prefix) sweep over the T sticks.
+     * @param w counts of the rows of phi
+     */
+    template<class V>
+    static void updateGammaElogSig(Mat<double>& gamma, Col<double>& eLogSig, const Mat<V>& phi, const Col<V>& w, double alpha)
+    {
+      uint32_t T = phi.n_cols;
+      Col<double> nPhi = conv_to<Col<double> >::from(Col<V>(phi.t()*w)); // expected number of words in each doc level topic
+
+      gamma.set_size(T,2);
+      double suffix = 0.0;
+      for (int32_t i=T-1; i>=0; --i){
+        gamma(i,0) = 1.0 + nPhi(i);
+        gamma(i,1) = alpha + suffix;
+        suffix += nPhi(i);
+      }
+      compElogSig(eLogSig,gamma);
+    };
+
+    /*
+     * natural gradient of the corpus level sticks a:
+     * d_a(k,0) = D sum_i zeta(i,k) + 1 and d_a(k,1) = D sum_i sum_{l>k} zeta(i,l) + omega
+     */
+    static void computeNaturalGradientA(Mat<double>& d_a, const Mat<double>& zeta, double omega, uint32_t D)
+    {
+      uint32_t K = zeta.n_cols;
+      Row<double> nZeta = sum(zeta,0); // expected number of doc level topics pointing to k
+
+      d_a.set_size(K,2);
+      double suffix = 0.0;
+      for (int32_t k=K-1; k>=0; --k){
+        d_a(k,0) = D*nZeta(k) + 1.0;
+        d_a(k,1) = D*suffix + omega;
+        suffix += nZeta(k);
+      }
+    };
+
     bool getWordTopics(Col<uint32_t>& z, const Mat<double>& phi) const {
 //      cout<<phi.n_rows<<" x "<<phi.n_cols<<endl;
       z.set_size(phi.n_rows);
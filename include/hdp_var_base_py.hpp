@@ -72,6 +72,25 @@ class HDP_var_base_py : public virtual HDP_var_base
 //      perp_wrap.at(i)=mPerp.at(i);
   };
 
+  bool getLocalIterations_py(numeric::array& it)
+  {
+    Col<uint32_t> it_wrap=np2col<uint32_t>(it); 
+    if(it_wrap.n_rows != HDP_var_base::mLocalIt.n_rows)
+      return false;
+    it_wrap = HDP_var_base::mLocalIt;
+    return true;
+  };
+
+  bool getDocSummaries_py(numeric::array& c)
+  {
+    Col<uint32_t> c_wrap=np2col<uint32_t>(c); 
+    if(c_wrap.n_rows != HDP_var_base::mDocTopic.size())
+      return false;
+    for (uint32_t d=0; d<c_wrap.n_rows; ++d)
+      c_wrap(d) = HDP_var_base::mDocTopic[d];
+    return true;
+  };
+
   /*
    * @param sigPi get topic probabilities sigPi
    * @param c pointer to corpus level topics
@@ -66,6 +66,23 @@ public:
     return HDP_var<U>::updateEst_batch(kappa,S);
   }
 
+  bool densityEstDistributed(uint32_t Nw, double kappa, uint32_t K, uint32_t T, uint32_t S, uint32_t P)
+  {
+    return HDP_var<U>::densityEstDistributed(Nw,kappa,K,T,S,P);
+  }
+
+  // out-of-core versions which read the docs from a file (see TextCorpusReader)
+  bool densityEstFromFile(const string& path, uint32_t Nw, double kappa, uint32_t K, uint32_t T, uint32_t S)
+  {
+    TextCorpusReader<U> reader(path);
+    return HDP_var<U>::densityEst(reader,Nw,kappa,K,T,S);
+  }
+  bool updateEstFromFile(const string& path, double kappa, uint32_t S)
+  {
+    TextCorpusReader<U> reader(path);
+    return HDP_var<U>::updateEst_batch(reader,kappa,S);
+  }
+
 
   uint32_t getTopicPriorDescriptionLength()
   {
@@ -199,13 +199,17 @@ class HDP_var_ss: public HDP_ss<uint32_t>, public virtual HDP_var_base
             Mat<double> gamma_prev(T,2);
             gamma_prev.ones();
             gamma_prev.col(1) += mAlpha;
+            Col<double> eLogSig_a;
+            compElogSig(eLogSig_a,a);
+            Col<double> eLogSig_gam(T);
+            Col<double> w = ones<Col<double> >(mNw);
             bool converged = false;
             uint32_t o=0;
             while(!converged){
               //           cout<<"-------------- Iterating local params #"<<o<<" -------------------------"<<endl;
-              updateGamma(gamma,phi);
-              updateZeta(zeta,phi,a,lambda,x.row(d));
-              updatePhi(phi,zeta,gamma,lambda,x.row(d));
+              updateGammaElogSig(gamma,eLogSig_gam,phi,w,mAlpha);
+              updateZeta(zeta,phi,eLogSig_a,lambda,x.row(d));
+              updatePhi(phi,zeta,eLogSig_gam,lambda,x.row(d));
 
               converged = (accu(gamma_prev != gamma))==0 || o>60 ;
               gamma_prev = gamma;
@@ -382,13 +386,17 @@ class HDP_var_ss: public HDP_ss<uint32_t>, public virtual HDP_var_base
       bool converged = false;
       Mat<double> gamma_prev(T,2);
       gamma_prev.ones();
+      Col<double> eLogSig_a;
+      compElogSig(eLogSig_a,a);
+      Col<double> eLogSig_gam(T);
+      Col<double> w = ones<Col<double> >(phi.n_rows);
 
       uint32_t o=0;
       while(!converged){
         //      cout<<"-------------- Iterating local params #"<<o<<" -------------------------"<<endl;
-        updateGamma(gamma,phi);
-        updateZeta(zeta,phi,a,lambda,x);
-        updatePhi(phi,zeta,gamma,lambda,x);
+        updateGammaElogSig(gamma,eLogSig_gam,phi,w,mAlpha);
+        updateZeta(zeta,phi,eLogSig_a,lambda,x);
+        updatePhi(phi,zeta,eLogSig_gam,lambda,x);
 
         converged = (accu(gamma_prev != gamma))==0 || o>60 ;
 
@@ -543,26 +551,10 @@ class HDP_var_ss: public HDP_ss<uint32_t>, public virtual HDP_var_base
       //cerr<<"phi>"<<endl<<phi<<"<phi"<<endl;
     };
 
-    void updateGamma(Mat<double>& gamma, const Mat<double>& phi)
-    {
-      uint32_t N = phi.n_rows;
-      uint32_t T = phi.n_cols;
-
-      gamma.ones();
-      gamma.col(1) *= mAlpha;
-      for (uint32_t i=0; i<T; ++i) 
-      {
-        for (uint32_t n=0; n<N; ++n){
-          gamma(i,0) += phi(n,i);
-          for (uint32_t j=i+1; j<T; ++j) {
-            gamma(i,1) += phi(n,j);
-          }
-        }
-      }
-      //cout<<gamma.t()<<endl;
-    };
-
-    void updateZeta(Mat<double>& zeta, const Mat<double>& phi, const Mat<double>& a, const Mat<double>& lambda, const Row<uint32_t>& x_d)
+    /*
+     * @param eLogSig_a E[log sigma(a)] from compElogSig()
+     */
+    void updateZeta(Mat<double>& zeta, const Mat<double>& phi, const Col<double>& eLogSig_a, const Mat<double>& lambda, const Row<uint32_t>& x_d)
     {
       uint32_t Nw = x_d.n_cols;
       uint32_t T = zeta.n_rows;
@@ -571,7 +563,7 @@ class HDP_var_ss: public HDP_ss<uint32_t>, public virtual HDP_var_base
       for (uint32_t i=0; i<T; ++i){
         //zeta(i,k)=0.0;
         for (uint32_t k=0; k<K; ++k) {
-          zeta(i,k) = ElogSigma(a,k);
+          zeta(i,k) = eLogSig_a(k);
           //cout<<zeta(i,k)<<endl;
           for (uint32_t w=0; w<Nw; ++w){
             zeta(i,k) += phi(w,i)*x_d(w)*ElogBeta(lambda,k,w);
@@ -582,7 +574,10 @@ class HDP_var_ss: public HDP_ss<uint32_t>, public virtual HDP_var_base
     }
 
 
-    void updatePhi(Mat<double>& phi, const Mat<double>& zeta, const Mat<double>& gamma, const Mat<double>& lambda, const Row<uint32_t>& x_d)
+    /*
+     * @param eLogSig_gam E[log sigma(gamma)] from updateGammaElogSig()
+     */
+    void updatePhi(Mat<double>& phi, const Mat<double>& zeta, const Col<double>& eLogSig_gam, const Mat<double>& lambda, const Row<uint32_t>& x_d)
     {
       uint32_t Nw = x_d.n_cols;
       uint32_t T = zeta.n_rows;
@@ -591,7 +586,7 @@ class HDP_var_ss: public HDP_ss<uint32_t>, public virtual HDP_var_base
       for (uint32_t w=0; w<Nw; ++w){
         //phi(n,i)=0.0;
         for (uint32_t i=0; i<T; ++i) {
-          phi(w,i) = ElogSigma(gamma,i);
+          phi(w,i) = eLogSig_gam(i);
           for (uint32_t k=0; k<K; ++k) {
             phi(w,i) += zeta(i,k)*x_d(w)*ElogBeta(lambda,k,w) ;
           }
@@ -607,7 +602,6 @@ class HDP_var_ss: public HDP_ss<uint32_t>, public virtual HDP_var_base
       uint32_t K = zeta.n_cols;
 
       d_lambda.zeros();
-      d_a.zeros();
       for (uint32_t k=0; k<K; ++k) { // for all K corpus level topics
         for (uint32_t i=0; i<T; ++i) {
           Row<double> _lambda(Nw); _lambda.zeros();
@@ -615,18 +609,13 @@ class HDP_var_ss: public HDP_ss<uint32_t>, public virtual HDP_var_base
             _lambda(w) += phi(w,i); // i think if I multiply by x_d(w) again here I am doing it twice (see updatePhi)  x_d(w)*phi(w,i);
           }
           d_lambda.row(k) += zeta(i,k) * _lambda;
-          d_a(k,0) += zeta(i,k);
-          for (uint32_t l=k+1; l<K; ++l) {
-            d_a(k,1) += zeta(i,l);
-          }
         }
         d_lambda.row(k) = D*d_lambda.row(k);
         //cout<<"lambda-nu="<<d_lambda[k].t()<<endl;
         d_lambda.row(k) += ((Dir*)(&mH))->mAlphas;
         //cout<<"lambda="<<d_lambda[k].t()<<endl;
-        d_a(k,0) = D*d_a(k,0)+1.0;
-        d_a(k,1) = D*d_a(k,1)+omega;
       }
+      computeNaturalGradientA(d_a, zeta, omega, D);
       //cout<<"da="<<d_a<<endl;
     }
 
@@ -651,14 +640,6 @@ class HDP_var_ss: public HDP_ss<uint32_t>, public virtual HDP_var_base
       return digamma(lambda(k,w)) - digamma(sum(lambda.row(k)));
     }
 
-    double ElogSigma(const Mat<double>& a, uint32_t k)
-    {
-      double e=digamma(a(k,0)) - digamma(a(k,0) + a(k,1));
-      for (uint32_t l=0; l<k; ++l)
-        e+=digamma(a(k,1)) - digamma(a(k,0) + a(k,1));
-      return e; 
-    }
-
 
     //bool normalizeLogDistribution(Row<double>& r)
     bool normalizeLogDistribution(arma::subview_row<double> r)
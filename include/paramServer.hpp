@@ -0,0 +1,220 @@
+/* Copyright (c) 2012, Julian Straub <jstraub@csail.mit.edu>
+ * Licensed under the MIT license. See LICENSE.txt or
+ * http://www.opensource.org/licenses/mit-license.php */
+
+#pragma once
+
+#include "topicBank.hpp"
+#include "probabilityHelpers.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <vector>
+#include <armadillo>
+
+using namespace std;
+using namespace arma;
+
+/*
+ * Parameter server for data parallel SVI of Dir topics. Workers are local
+ * processes connected through Unix domain sockets (see
+ * HDP_var::densityEstDistributed()). Before each minibatch a worker pulls
+ * E[log beta] for the vocabulary of its minibatch together with the stick
+ * parameters a; afterwards it pushes the sparse natural gradients. The
+ * server applies them as they arrive (asynchronous SVI) with the step size
+ * ro of the global doc count.
+ *
+ * messages (worker -> server):
+ *  PULL: type, n, n words             -> reply: K x n E[log beta], K x 2 a
+ *  PUSH: type, n, bS, n words, K x n dLambda, K x 2 da
+ *  DONE: type
+ */
+enum PsMsgType {PS_PULL=1, PS_PUSH=2, PS_DONE=3};
+
+// blocking send/receive of len bytes over a socket
+inline bool psSend(int fd, const void* data, size_t len)
+{
+  const char* p = (const char*)data;
+  while (len > 0)
+  {
+    ssize_t n = send(fd, p, len, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n; len -= n;
+  }
+  return true;
+};
+
+inline bool psRecv(int fd, void* data, size_t len)
+{
+  char* p = (char*)data;
+  while (len > 0)
+  {
+    ssize_t n = recv(fd, p, len, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n; len -= n;
+  }
+  return true;
+};
+
+// thread count setters of the threaded BLAS libraries; weak so that they are
+// NULL unless the BLAS armadillo links against provides them
+extern "C" void openblas_set_num_threads(int) __attribute__((weak));
+extern "C" void goto_set_num_threads(int) __attribute__((weak));
+extern "C" void MKL_Set_Num_Threads(int) __attribute__((weak));
+
+/*
+ * has to be called in a worker right after fork(): only the forking thread
+ * survives, so thread pools of OpenMP or a threaded BLAS that were started
+ * in the parent are gone in the child. Running single threaded keeps them
+ * from being used.
+ */
+inline void psWorkerInit()
+{
+#ifdef _OPENMP
+  omp_set_num_threads(1);
+  omp_set_dynamic(0);
+#endif
+  if (openblas_set_num_threads) openblas_set_num_threads(1);
+  if (goto_set_num_threads) goto_set_num_threads(1);
+  if (MKL_Set_Num_Threads) MKL_Set_Num_Threads(1);
+};
+
+class DirParamServer
+{
+public:
+  /*
+   * @param a stick parameters (K x 2); updated in place
+   * @param bank Dir topics; updated in place
+   */
+  DirParamServer(DirTopicBank& bank, Mat<double>& a, double kappa, uint32_t t0=0)
+    : mBank(bank), mA(a), mKappa(kappa), mT(t0)
+  {};
+
+  // serves the workers connected through fds until all of them are done
+  void serve(const vector<int>& fds)
+  {
+    vector<pollfd> pfds(fds.size());
+    for (uint32_t i=0; i<fds.size(); ++i)
+    {
+      pfds[i].fd = fds[i];
+      pfds[i].events = POLLIN;
+    }
+    uint32_t active = fds.size();
+    while (active > 0)
+    {
+      if (poll(&pfds[0], pfds.size(), -1) < 0)
+      {
+        if (errno == EINTR) continue;
+        cerr<<"DirParamServer: poll failed"<<endl;
+        return;
+      }
+      for (uint32_t i=0; i<pfds.size(); ++i)
+        if (pfds[i].fd >= 0 && (pfds[i].revents & (POLLIN|POLLHUP|POLLERR)))
+          if (!handle(pfds[i].fd))
+          { // worker is done or gone
+            pfds[i].fd = -1;
+            --active;
+          }
+    }
+  };
+
+  // number of docs whose gradients have been applied
+  uint32_t docCount() const { return mT; };
+
+private:
+  DirTopicBank& mBank;
+  Mat<double>& mA;
+  double mKappa;
+  uint32_t mT;
+
+  // @return false if the worker is done
+  bool handle(int fd)
+  {
+    uint32_t type;
+    if (!psRecv(fd,&type,sizeof(uint32_t))) return false;
+    uint32_t K = mBank.K();
+    if (type == PS_PULL)
+    {
+      uint32_t n;
+      if (!psRecv(fd,&n,sizeof(uint32_t))) return false;
+      Col<uint32_t> words(n);
+      if (!psRecv(fd,words.memptr(),n*sizeof(uint32_t))) return false;
+      Mat<double> tab;
+      mBank.ElogTable(words,tab);
+      return psSend(fd,tab.memptr(),K*n*sizeof(double))
+        && psSend(fd,mA.memptr(),K*2*sizeof(double));
+    }else if (type == PS_PUSH){
+      uint32_t hdr[2]; // n, bS
+      if (!psRecv(fd,hdr,2*sizeof(uint32_t))) return false;
+      uint32_t n = hdr[0], bS = hdr[1];
+      Col<uint32_t> words(n);
+      Mat<double> dLambda(K,n);
+      Mat<double> da(K,2);
+      if (!psRecv(fd,words.memptr(),n*sizeof(uint32_t))
+          || !psRecv(fd,dLambda.memptr(),K*n*sizeof(double))
+          || !psRecv(fd,da.memptr(),K*2*sizeof(double)))
+        return false;
+      double ro = exp(-mKappa*log(1+double(mT)+double(bS)/2.0)); // as "time" use the middle of the batch
+      mBank.update(words, dLambda/bS, ro);
+      mA = (1.0-ro)*mA + (ro/bS)*da;
+      mT += bS;
+      return true;
+    }
+    return false; // PS_DONE
+  };
+};
+
+class DirParamClient
+{
+public:
+  DirParamClient(int fd, uint32_t K)
+    : mFd(fd), mK(K)
+  {};
+
+  // E[log beta] (K x words.n_elem) for the given words and the stick parameters a
+  bool pull(const Col<uint32_t>& words, Mat<double>& tab, Mat<double>& a)
+  {
+    uint32_t hdr[2] = {PS_PULL, words.n_elem};
+    tab.set_size(mK,words.n_elem);
+    a.set_size(mK,2);
+    return psSend(mFd,hdr,2*sizeof(uint32_t))
+      && psSend(mFd,words.memptr(),words.n_elem*sizeof(uint32_t))
+      && psRecv(mFd,tab.memptr(),tab.n_elem*sizeof(double))
+      && psRecv(mFd,a.memptr(),a.n_elem*sizeof(double));
+  };
+
+  /*
+   * @param dLambda natural gradient of the topics summed over the bS docs (K x words.n_elem)
+   * @param da natural gradient of a summed over the bS docs (K x 2)
+   */
+  bool push(const Col<uint32_t>& words, const Mat<double>& dLambda, const Mat<double>& da, uint32_t bS)
+  {
+    uint32_t hdr[3] = {PS_PUSH, words.n_elem, bS};
+    return psSend(mFd,hdr,3*sizeof(uint32_t))
+      && psSend(mFd,words.memptr(),words.n_elem*sizeof(uint32_t))
+      && psSend(mFd,dLambda.memptr(),dLambda.n_elem*sizeof(double))
+      && psSend(mFd,da.memptr(),da.n_elem*sizeof(double));
+  };
+
+  bool done()
+  {
+    uint32_t type = PS_DONE;
+    return psSend(mFd,&type,sizeof(uint32_t));
+  };
+
+private:
+  int mFd;
+  uint32_t mK;
+};
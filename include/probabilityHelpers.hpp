@@ -34,6 +34,12 @@ void stickBreaking(Row<double>& prop, const Row<double>& v);
 uint32_t multinomialMode(const Row<double>& p);
 void dirMode(Row<double>& mode, const Row<double>& alpha);
 void dirMode(Col<double>& mode, const Col<double>& alpha);
+// normalize each row of log probabilities r in place to a probability distribution (log sum exp trick)
+void normalizeLogDistributionRows(Mat<double>& r);
+void normalizeLogDistributionRows(Mat<float>& r);
+// rank-one update (sign=1) or downdate (sign=-1) of the lower Cholesky factor L of A to the factor of A + sign*x*x^T in O(d^2);
+// returns false if a downdate leaves A not positive definite (L is invalid then)
+bool cholUpdate(Mat<double>& L, Col<double> x, double sign=1.0);
 
 template <class U>
 Row<uint32_t> size(Mat<U> A)
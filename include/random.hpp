@@ -15,12 +15,18 @@
 
 using namespace arma;
 
+/*
+ * All generators are seeded with time(0) unless a seed is given; 
+ * generators that are used side by side need distinct seeds since 
+ * otherwise they draw the same mt19937 stream.
+ */
+
 
 class GammaRnd
 {
 public:
-  GammaRnd(double alpha, double beta) // alpha = shape; beta = scale
-    : mGen(time(0)),mAlpha(alpha), mBeta(beta), mGamma(mAlpha)
+  GammaRnd(double alpha, double beta, uint32_t seed=time(0)) // alpha = shape; beta = scale
+    : mGen(seed),mAlpha(alpha), mBeta(beta), mGamma(mAlpha)
   {};
 
   double draw(void)
@@ -46,12 +52,40 @@ private:
   boost::gamma_distribution<> mGamma;
 };
 
+/*
+ * Dirichlet distributed random vectors; unlike GammaRnd the parameters may
+ * change from draw to draw 
+ */
+class DirRnd
+{
+public:
+  DirRnd(uint32_t seed=time(0)) : mGen(seed)
+  { };
+
+  // entries with alpha(i) = 0 stay 0
+  void draw(Row<double>& pi, const Row<double>& alpha)
+  {
+    pi.set_size(alpha.n_elem);
+    for (uint32_t i=0; i<alpha.n_elem; ++i)
+      if (alpha(i) > 0.0)
+      {
+        boost::gamma_distribution<> gamma(alpha(i));
+        pi(i) = gamma(mGen);
+      }else
+        pi(i) = 0.0;
+    pi /= sum(pi);
+  };
+
+private:
+  boost::mt19937 mGen;
+};
+
 
 class RandInt
 {
 public:
-  RandInt(uint32_t limLower, uint32_t limUpper)
-    : mGen(time(0)),  mDist(limLower,limUpper-1) // so we generate numbers in the range( upper - lower)
+  RandInt(uint32_t limLower, uint32_t limUpper, uint32_t seed=time(0))
+    : mGen(seed),  mDist(limLower,limUpper-1) // so we generate numbers in the range( upper - lower)
   {};
 
   uint32_t draw(void)
@@ -82,7 +116,7 @@ private:
 class RandDisc
 {
 public:
-  RandDisc() : mGen(time(0))
+  RandDisc(uint32_t seed=time(0)) : mGen(seed)
   { };
 
   double draw(void)
@@ -105,18 +139,32 @@ private:
   boost::uniform_01<> mDist;
 };
 
-uint32_t sampleDiscLogProb(RandDisc& rndDisc, colvec l)
+/*
+ * number of tables that n customers occupy in a Chinese restaurant with 
+ * concentration ab (Antoniak): the l-th customer sits at a new table with
+ * probability ab/(ab+l)
+ */
+inline uint32_t sampleTables(RandDisc& rndDisc, double ab, uint32_t n)
 {
-  //    cout<<"max(l)="<<l.max()<<" min(l)="<<l.min()<<endl;
-  double lmax=l.max();
-  double lmin=l.min();
+  uint32_t m = 0;
+  for (uint32_t l=0; l<n; ++l)
+    if (rndDisc.draw() < ab/(ab+l))
+      ++m;
+  return m;
+};
+
+/*
+ * sample from the unnormalized log probabilities l; the max is subtracted 
+ * before exponentiating (non finite entries -> probability 0)
+ */
+inline uint32_t sampleDiscLogProb(RandDisc& rndDisc, colvec l)
+{
+  double lmax = -datum::inf;
+  for(uint32_t i=0; i<l.n_elem; ++i)
+    if(is_finite(l(i)) && l(i) > lmax)
+      lmax = l(i);
   for(uint32_t i=0; i<l.n_elem; ++i)
-    if(!is_finite(l(i)))
-      l(i)=0.0;
-    else
-      l(i)=exp(l(i) + (lmax - lmin)*0.5);
-  //    cout<<"l(exp) ="<<l.t()<<endl;
-  //    cout<<"l(norm) ="<<l.t()/sum(l)<<endl;
+    l(i) = is_finite(l(i)) ? exp(l(i) - lmax) : 0.0;
   return rndDisc.draw(l/sum(l));
 };
 
@@ -0,0 +1,199 @@
+/* Copyright (c) 2012, Julian Straub <jstraub@csail.mit.edu>
+ * Licensed under the MIT license. See LICENSE.txt or
+ * http://www.opensource.org/licenses/mit-license.php */
+
+#pragma once
+
+#include "baseMeasure.hpp"
+#include "probabilityHelpers.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <armadillo>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+using namespace std;
+using namespace arma;
+
+/*
+ * K Dirichlet topics over Nw words stored in one contiguous K x Nw matrix
+ * for stochastic variational inference. Each topic is kept as
+ *   lambda_k = eta + s_k * M_k
+ * with the prior eta, a running scale s_k and the unscaled statistics M_k.
+ * The SVI decay (1-ro)*lambda_k only changes s_k; the decay reaches a word
+ * when its value is read (as in Hoffman's online LDA). Hence a sparse
+ * gradient only touches the words of the minibatch and the cost of an
+ * update is independent of the dictionary size. Row sums are cached so
+ * E[log beta_kw] costs two digammas.
+ */
+class DirTopicBank
+{
+public:
+  DirTopicBank()
+    : mK(0), mNw(0), mEta0(0.0)
+  {};
+
+  /*
+   * @param lambda K Dir topics (as obtained from the global updates)
+   * @param eta prior alphas of the base measure
+   */
+  template<class U>
+  void init(const DistriContainer<U>& lambda, const Row<double>& eta)
+  {
+    mK = lambda.size();
+    mNw = eta.n_elem;
+    mEta = eta;
+    mEta0 = sum(eta);
+    mScale.ones(mK);
+    mM.set_size(mK,mNw);
+    mMsum.set_size(mK);
+    for (uint32_t k=0; k<mK; ++k)
+    {
+      mM.row(k) = lambda[k]->asRow() - mEta;
+      mMsum(k) = sum(mM.row(k));
+    }
+  };
+
+  // write the topics back into lambda (dense; O(K*Nw))
+  template<class U>
+  void toContainer(DistriContainer<U>& lambda) const
+  {
+    for (uint32_t k=0; k<mK; ++k)
+      lambda[k]->fromRow(mEta + mScale(k)*mM.row(k));
+  };
+
+  double alpha(uint32_t k, uint32_t w) const
+  {
+    return mEta(w) + mScale(k)*mM(k,w);
+  };
+
+  double alpha0(uint32_t k) const
+  {
+    return mEta0 + mScale(k)*mMsum(k);
+  };
+
+  /*
+   * E[log beta_kw] for all K topics and the given words
+   * @param tab K x words.n_elem
+   */
+  template<class V>
+  void ElogTable(const Col<uint32_t>& words, Mat<V>& tab) const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(mFoldLock); // see updateHogwild()
+    tab.set_size(mK,words.n_elem);
+    Col<double> digam_alpha0(mK);
+    for (uint32_t k=0; k<mK; ++k)
+      digam_alpha0(k) = digamma(alpha0(k));
+#pragma omp parallel for schedule(static)
+    for (uint32_t j=0; j<words.n_elem; ++j)
+      for (uint32_t k=0; k<mK; ++k)
+        tab(k,j) = digamma(alpha(k,words(j))) - digam_alpha0(k);
+  };
+
+  /*
+   * lambda_k = (1-ro)*lambda_k + ro*(eta + dM_k) where dM is only non-zero
+   * for the given words
+   * @param dM K x words.n_elem
+   */
+  void update(const Col<uint32_t>& words, const Mat<double>& dM, double ro)
+  {
+    for (uint32_t k=0; k<mK; ++k)
+    {
+      mScale(k) *= 1.0-ro;
+      if (mScale(k) < 1e-100)
+      { // fold the scale into the statistics before it underflows (rare; O(Nw))
+        mM.row(k) *= mScale(k);
+        mMsum(k) *= mScale(k);
+        mScale(k) = 1.0;
+      }
+    }
+    for (uint32_t j=0; j<words.n_elem; ++j)
+      for (uint32_t k=0; k<mK; ++k)
+      {
+        double dm = ro*dM(k,j)/mScale(k);
+        mM(k,words(j)) += dm;
+        mMsum(k) += dm;
+      }
+  };
+
+  /*
+   * update() of a single document for Hogwild style training: any number 
+   * of threads may call it concurrently and while others read the topics 
+   * (ElogTable()). The additions use relaxed atomics only, so updates of 
+   * different docs interleave (on sparse text they rarely touch the same 
+   * words). Updates and reads share mFoldLock; folding a vanishing scale 
+   * into the statistics is rare and takes it exclusively, so no addition
+   * is ever made with the scale from before a fold into the folded row.
+   * @param dM K x words.n_elem
+   */
+  void updateHogwild(const Col<uint32_t>& words, const Mat<double>& dM, double ro)
+  {
+    double* scale = mScale.memptr();
+    double* Msum = mMsum.memptr();
+    bool fold = false;
+    {
+      boost::shared_lock<boost::shared_mutex> lock(mFoldLock);
+      for (uint32_t k=0; k<mK; ++k)
+      {
+        double s_k;
+#pragma omp atomic capture
+        { scale[k] *= 1.0-ro; s_k = scale[k]; }
+        if (s_k < 1e-100) fold = true;
+      }
+    }
+    if (fold)
+    {
+      boost::unique_lock<boost::shared_mutex> lock(mFoldLock);
+      for (uint32_t k=0; k<mK; ++k)
+        if (scale[k] < 1e-100)
+        { // some other thread may have folded it already
+          mM.row(k) *= scale[k];
+          Msum[k] *= scale[k];
+          scale[k] = 1.0;
+        }
+    }
+
+    boost::shared_lock<boost::shared_mutex> lock(mFoldLock);
+    Col<double> s(mK); 
+    for (uint32_t k=0; k<mK; ++k)
+    {
+      double s_k;
+#pragma omp atomic read
+      s_k = scale[k];
+      s(k) = s_k;
+    }
+    Col<double> dMsum(mK);
+    dMsum.zeros();
+    for (uint32_t j=0; j<words.n_elem; ++j)
+    {
+      double* M_w = mM.colptr(words(j));
+      for (uint32_t k=0; k<mK; ++k)
+      {
+        double dm = ro*dM(k,j)/s(k);
+#pragma omp atomic
+        M_w[k] += dm;
+        dMsum(k) += dm;
+      }
+    }
+    for (uint32_t k=0; k<mK; ++k)
+    {
+#pragma omp atomic
+      Msum[k] += dMsum(k);
+    }
+  };
+
+  uint32_t K() const { return mK; };
+  uint32_t Nw() const { return mNw; };
+
+protected:
+  uint32_t mK;
+  uint32_t mNw;
+  Row<double> mEta; // prior
+  double mEta0; // sum over prior
+  Col<double> mScale; // scale s_k for each topic
+  Mat<double> mM; // K x Nw unscaled statistics
+  Col<double> mMsum; // unscaled row sums of mM
+  mutable boost::shared_mutex mFoldLock; // shared by Hogwild updates and reads; exclusive to fold a scale
+};
@@ -0,0 +1,152 @@
+/* Copyright (c) 2012, Julian Straub <jstraub@csail.mit.edu>
+ * Licensed under the MIT license. See LICENSE.txt or
+ * http://www.opensource.org/licenses/mit-license.php */
+
+/*
+ * Benchmarks HDP_var on a synthetic corpus drawn from a Dir topic model
+ * (wall time of densityEst and of the held out perplexity):
+ *  - double vs. float compute mode of the doc level updates
+ *  - virtual vs. static dispatch (H=Dir) of the base measure; the minibatch
+ *    updates of Dir go through the DirTopicBank for either H, so only the
+ *    held out perplexity (doc level updates and mixture) differs
+ *  - convergence of synchronous minibatch vs. Hogwild updates over the 
+ *    number of docs seen
+ *  - scaling efficiency of the data parallel parameter server mode over 
+ *    the number of worker processes
+ *
+ * usage: benchHdpVar [D] [Nw] [K] [T] [S]
+ */
+
+#include "hdp_var.hpp"
+
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+
+#include <armadillo>
+
+using namespace std;
+using namespace arma;
+
+// draws D docs with N words each from Ktrue topics over Nw words
+void sampleCorpus(vector<Mat<uint32_t> >& x, uint32_t D, uint32_t N, uint32_t Nw, uint32_t Ktrue)
+{
+  Mat<double> cdf(Ktrue,Nw);
+  for (uint32_t k=0; k<Ktrue; ++k)
+  { // each topic concentrates on its own block of words
+    Row<double> beta = randu<Row<double> >(Nw)*0.1;
+    uint32_t w0 = k*(Nw/Ktrue);
+    beta.cols(w0,w0+Nw/Ktrue-1) += 1.0;
+    cdf.row(k) = cumsum(beta/sum(beta));
+  }
+  x.resize(D);
+  for (uint32_t d=0; d<D; ++d)
+  {
+    x[d].set_size(1,N);
+    uint32_t k0 = rand()%Ktrue, k1 = rand()%Ktrue; // two topics per doc
+    for (uint32_t n=0; n<N; ++n)
+    {
+      uint32_t k = (rand()%3==0)?k1:k0;
+      double u = randu<vec>(1)(0);
+      uint32_t w=0;
+      while (w<Nw-1 && cdf(k,w)<u) ++w;
+      x[d](0,n) = w;
+    }
+  }
+};
+
+typedef BaseMeasure<uint32_t> AnyBase; // H of the virtual dispatch
+
+template<class R, class H>
+double bench(const char* name, const vector<Mat<uint32_t> >& x, const vector<Mat<uint32_t> >& x_te,
+    const vector<Mat<uint32_t> >& x_ho, uint32_t Nw, uint32_t K, uint32_t T, uint32_t S, bool hogwild=false)
+{
+  double kappa = 0.9;
+  Row<double> alphas(Nw);
+  alphas.fill(0.1);
+  Dir dir(alphas);
+  HDP_var<uint32_t,R,H> hdp(dir, 1.0, 10.0);
+  hdp.setHogwild(hogwild);
+
+  srand(1); // same shuffling of the docs for both compute modes
+  wall_clock timer;
+  timer.tic();
+  hdp.densityEst(x,Nw,kappa,K,T,S);
+  double t = timer.toc();
+
+  Col<uint32_t> it;
+  hdp.getLocalIterations(it);
+  double perp = 0.0;
+  timer.tic();
+  for (uint32_t i=0; i<x_te.size(); ++i)
+    perp += hdp.perplexity(x_te[i],x_ho[i],x.size(),kappa);
+  double tPerp = timer.toc();
+  perp /= double(x_te.size());
+
+  cerr<<name<<": D="<<x.size()<<" time="<<t<<"s mean local iterations="<<mean(conv_to<Col<double> >::from(it))
+    <<" held out perplexity="<<perp<<" ("<<tPerp<<"s)"<<endl;
+  return perp;
+};
+
+int main(int argc, char** argv)
+{
+  uint32_t D  = argc>1 ? atoi(argv[1]) : 1000;
+  uint32_t Nw = argc>2 ? atoi(argv[2]) : 5000;
+  uint32_t K  = argc>3 ? atoi(argv[3]) : 100;
+  uint32_t T  = argc>4 ? atoi(argv[4]) : 20;
+  uint32_t S  = argc>5 ? atoi(argv[5]) : 50;
+  uint32_t N = 200; // words per doc
+  uint32_t Ktrue = 20;
+
+  srand(0);
+  vector<Mat<uint32_t> > x, x_eval;
+  sampleCorpus(x, D, N, Nw, Ktrue);
+  sampleCorpus(x_eval, 20, N, Nw, Ktrue);
+  vector<Mat<uint32_t> > x_te, x_ho;
+  for (uint32_t i=0; i<x_eval.size(); ++i)
+  { // train on the first 10% of each held out doc; evaluate on the rest
+    uint32_t N_te = N/10;
+    x_te.push_back(x_eval[i].cols(0,N_te-1));
+    x_ho.push_back(x_eval[i].cols(N_te,N-1));
+  }
+
+  cerr<<"D="<<D<<" Nw="<<Nw<<" K="<<K<<" T="<<T<<" S="<<S<<endl;
+  cerr<<" -- compute precision"<<endl;
+  bench<double,AnyBase>("double", x, x_te, x_ho, Nw, K, T, S);
+  bench<float,AnyBase>("float ", x, x_te, x_ho, Nw, K, T, S);
+
+  cerr<<" -- dispatch of the base measure"<<endl;
+  bench<double,AnyBase>("virtual", x, x_te, x_ho, Nw, K, T, S);
+  bench<double,Dir>("static ", x, x_te, x_ho, Nw, K, T, S);
+
+  cerr<<" -- convergence: synchronous minibatches vs. Hogwild"<<endl;
+  for (uint32_t Dp=max(D/8,uint32_t(1)); Dp<=D; Dp*=2)
+  {
+    vector<Mat<uint32_t> > xp(x.begin(),x.begin()+Dp);
+    double perpSync = bench<double,AnyBase>("sync   ", xp, x_te, x_ho, Nw, K, T, S, false);
+    double perpHog = bench<double,AnyBase>("hogwild", xp, x_te, x_ho, Nw, K, T, S, true);
+    cerr<<"D="<<Dp<<" perplexity hogwild-sync="<<perpHog-perpSync<<endl;
+  }
+
+  cerr<<" -- data parallel workers"<<endl;
+  double t1 = 0.0;
+  for (uint32_t P=1; P<=8; P*=2)
+  {
+    Row<double> alphas(Nw);
+    alphas.fill(0.1);
+    Dir dir(alphas);
+    HDP_var<uint32_t> hdp(dir, 1.0, 10.0);
+    wall_clock timer;
+    timer.tic();
+    hdp.densityEstDistributed(x,Nw,0.9,K,T,S,P);
+    double t = timer.toc();
+    if (P == 1) t1 = t;
+    double perp = 0.0;
+    for (uint32_t i=0; i<x_te.size(); ++i)
+      perp += hdp.perplexity(x_te[i],x_ho[i],x.size(),0.9);
+    perp /= double(x_te.size());
+    cerr<<"P="<<P<<": time="<<t<<"s speedup="<<t1/t<<" efficiency="<<t1/(P*t)
+      <<" held out perplexity="<<perp<<endl;
+  }
+  return 0;
+}
@@ -4,6 +4,7 @@
 
 #include <baseMeasure_py.hpp>
 #include <hdp_gibbs_py.hpp>
+#include <hdp_gibbs_da_py.hpp>
 #include <hdp_var_py.hpp>
 #include <hdp_var_base_py.hpp>
 // using the hdp which utilizes sufficient statistics 
@@ -45,6 +46,11 @@ BOOST_PYTHON_MODULE(libbnp)
       .def("asRow",&NIW_py::asRow)
       .def("rowDim",&NIW_py::rowDim);
 
+	class_<NormalGamma_py>("NormalGamma",init<const numeric::array, double, double, const numeric::array>())
+			.def(init<NormalGamma_py>())
+      .def("asRow",&NormalGamma_py::asRow)
+      .def("rowDim",&NormalGamma_py::rowDim);
+
 	//	class_<DP_Dir>("DP_Dir",init<Dir_py,double>());
 	//	class_<DP_INW>("DP_INW",init<NIW_py,double>());
 
@@ -57,15 +63,43 @@ BOOST_PYTHON_MODULE(libbnp)
   //      .def_readonly("mGamma", &HDP_Dir::mGamma);
 
 	class_<HDP_gibbs_NIW>("HDP_gibbs_NIW",init<NIW_py&,double,double>())
+        .def(init<NormalGamma_py&,double,double>()) // diagonal covariance
         .def("densityEst",&HDP_gibbs_NIW::densityEst)
         .def("getClassLabels",&HDP_gibbs_NIW::getClassLabels)
         .def("addDoc",&HDP_gibbs_NIW::addDoc);
   //      .def_readonly("mGamma", &HDP_NIW::mGamma);
 
+	class_<HDP_gibbs_da_Dir>("HDP_gibbs_da_Dir",init<Dir_py&,double,double>())
+        .def("densityEst",&HDP_gibbs_da_Dir::densityEst)
+        .def("getClassLabels",&HDP_gibbs_da_Dir::getClassLabels)
+        .def("getWeights",&HDP_gibbs_da_Dir::getWeights)
+        .def("addDoc",&HDP_gibbs_da_Dir::addDoc)
+        .def("addHeldOut",&HDP_gibbs_da_Dir::addHeldOut)
+        .def("getPerplexity",&HDP_gibbs_da_Dir::getPerplexity)
+        .def("setSeed",&HDP_gibbs_da_Dir::setSeed);
+
+	class_<HDP_gibbs_da_NIW>("HDP_gibbs_da_NIW",init<NIW_py&,double,double>())
+        .def(init<NormalGamma_py&,double,double>()) // diagonal covariance
+        .def("densityEst",&HDP_gibbs_da_NIW::densityEst)
+        .def("getClassLabels",&HDP_gibbs_da_NIW::getClassLabels)
+        .def("getWeights",&HDP_gibbs_da_NIW::getWeights)
+        .def("addDoc",&HDP_gibbs_da_NIW::addDoc)
+        .def("setSeed",&HDP_gibbs_da_NIW::setSeed);
+
 	class_<HDP_var_Dir_py>("HDP_var_Dir",init<Dir_py&,double,double>())
         .def("densityEst",&HDP_var_Dir_py::densityEst)
         //TODO: not sure that one works: .def("updateEst",&HDP_var_Dir_py::updateEst)
         .def("updateEst_batch",&HDP_var_Dir_py::updateEst_batch)
+        .def("densityEstFromFile",&HDP_var_Dir_py::densityEstFromFile)
+        .def("densityEstDistributed",&HDP_var_Dir_py::densityEstDistributed)
+        .def("updateEstFromFile",&HDP_var_Dir_py::updateEstFromFile)
+        .def("setLocalConvergence",&HDP_var_Dir_py::setLocalConvergence)
+        .def("getLocalIterations",&HDP_var_Dir_py::getLocalIterations_py)
+        .def("setStreaming",&HDP_var_Dir_py::setStreaming)
+        .def("setPipelined",&HDP_var_Dir_py::setPipelined)
+        .def("setHogwild",&HDP_var_Dir_py::setHogwild)
+        .def("getDocsDiscarded",&HDP_var_Dir_py::getDocsDiscarded)
+        .def("getDocSummaries",&HDP_var_Dir_py::getDocSummaries_py)
         .def("addDoc",&HDP_var_Dir_py::addDoc)
         .def("addHeldOut",&HDP_var_Dir_py::addHeldOut)
         .def("getPerplexity",&HDP_var_Dir_py::getPerplexity_py)
@@ -82,9 +116,19 @@ BOOST_PYTHON_MODULE(libbnp)
 //        .def("perplexity",&HDP_var_Dir_py::perplexity)
 
 	class_<HDP_var_NIW_py>("HDP_var_NIW",init<NIW_py&,double,double>())
+        .def(init<NormalGamma_py&,double,double>()) // diagonal covariance
         .def("densityEst",&HDP_var_NIW_py::densityEst)
         //TODO: not sure that one works: .def("updateEst",&HDP_var_NIW_py::updateEst)
         .def("updateEst_batch",&HDP_var_NIW_py::updateEst_batch)
+        .def("densityEstFromFile",&HDP_var_NIW_py::densityEstFromFile)
+        .def("updateEstFromFile",&HDP_var_NIW_py::updateEstFromFile)
+        .def("setLocalConvergence",&HDP_var_NIW_py::setLocalConvergence)
+        .def("getLocalIterations",&HDP_var_NIW_py::getLocalIterations_py)
+        .def("setStreaming",&HDP_var_NIW_py::setStreaming)
+        .def("setPipelined",&HDP_var_NIW_py::setPipelined)
+        .def("setHogwild",&HDP_var_NIW_py::setHogwild)
+        .def("getDocsDiscarded",&HDP_var_NIW_py::getDocsDiscarded)
+        .def("getDocSummaries",&HDP_var_NIW_py::getDocSummaries_py)
         .def("addDoc",&HDP_var_NIW_py::addDoc)
         .def("addHeldOut",&HDP_var_NIW_py::addHeldOut)
         .def("getPerplexity",&HDP_var_NIW_py::getPerplexity_py)
@@ -206,3 +206,74 @@ void dirMode(Col<double>& mode, const Col<double>& alpha)
   }
   mode = (alpha_mod-1.0)/sum(alpha_mod-1.0);
 };
+
+template<class V>
+static void normalizeLogDistributionRows_(Mat<V>& r)
+{
+  // known as the log sum exp trick - done for all rows at once and sweeping
+  // along the columns to follow the (column major) memory layout 
+  const uint32_t N = r.n_rows;
+  if (N == 0 || r.n_cols == 0) return;
+
+  Col<V> maxR = r.col(0);
+  V* maxR_p = maxR.memptr();
+  for (uint32_t j=1; j<r.n_cols; ++j)
+  {
+    const V* r_j = r.colptr(j);
+    for (uint32_t n=0; n<N; ++n)
+      if (r_j[n] > maxR_p[n]) maxR_p[n] = r_j[n];
+  }
+  Col<V> sumR(N);
+  sumR.zeros();
+  V* sumR_p = sumR.memptr();
+  for (uint32_t j=0; j<r.n_cols; ++j)
+  {
+    V* r_j = r.colptr(j);
+    for (uint32_t n=0; n<N; ++n)
+    {
+      r_j[n] = exp(r_j[n] - maxR_p[n]);
+      sumR_p[n] += r_j[n];
+    }
+  }
+  for (uint32_t n=0; n<N; ++n)
+    sumR_p[n] = V(1)/sumR_p[n];
+  for (uint32_t j=0; j<r.n_cols; ++j)
+  {
+    V* r_j = r.colptr(j);
+    for (uint32_t n=0; n<N; ++n)
+      r_j[n] *= sumR_p[n];
+  }
+};
+
+void normalizeLogDistributionRows(Mat<double>& r)
+{
+  normalizeLogDistributionRows_(r);
+};
+
+void normalizeLogDistributionRows(Mat<float>& r)
+{
+  normalizeLogDistributionRows_(r);
+};
+
+bool cholUpdate(Mat<double>& L, Col<double> x, double sign)
+{
+  // Givens style sweep over the columns of L (column major -> the inner loop is contiguous)
+  const uint32_t d = L.n_rows;
+  double* x_p = x.memptr();
+  for (uint32_t k=0; k<d; ++k)
+  {
+    double* L_k = L.colptr(k);
+    double r2 = L_k[k]*L_k[k] + sign*x_p[k]*x_p[k];
+    if (!(r2 > 0.0)) return false;
+    double r = sqrt(r2);
+    double c = r/L_k[k];
+    double s = x_p[k]/L_k[k];
+    L_k[k] = r;
+    for (uint32_t i=k+1; i<d; ++i)
+    {
+      L_k[i] = (L_k[i] + sign*s*x_p[i])/c;
+      x_p[i] = c*x_p[i] - s*L_k[i];
+    }
+  }
+  return true;
+};
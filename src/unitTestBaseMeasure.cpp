@@ -0,0 +1,143 @@
+
+
+#include <armadillo>
+
+#include "baseMeasure.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE baseMeasure
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace arma;
+
+// log of the Student-t posterior predictive of x under a NIW after the points X; textbook formulas
+double niwPredictive(const colvec& x, const mat& X, const colvec& vtheta0, double kappa0, const mat& Delta0, double nu0)
+{
+  double d = x.n_elem;
+  double n = X.n_cols;
+  double kappa = kappa0 + n;
+  double nu = nu0 + n;
+  colvec xbar = vtheta0;
+  mat S = zeros<mat>(d,d);
+  if (n > 0)
+  {
+    xbar = sum(X,1)/n;
+    for (uint32_t i=0; i<X.n_cols; ++i)
+      S += (X.col(i)-xbar)*trans(X.col(i)-xbar);
+  }
+  colvec mu = (kappa0*vtheta0 + n*xbar)/kappa;
+  mat Delta = Delta0 + S + (kappa0*n/kappa)*(xbar-vtheta0)*trans(xbar-vtheta0);
+  double dof = nu-d+1.0;
+  mat Sigma = (kappa+1.0)/(kappa*dof)*Delta;
+  double q = as_scalar(trans(x-mu)*inv(Sigma)*(x-mu));
+  return boost::math::lgamma(0.5*(dof+d)) - boost::math::lgamma(0.5*dof) - 0.5*d*log(dof*datum::pi)
+    - 0.5*log(det(Sigma)) - 0.5*(dof+d)*log(1.0+q/dof);
+}
+
+BOOST_AUTO_TEST_CASE( niwPredictiveTest )
+{
+  // points far from the origin around a prior mean close to them: the
+  // uncentered sum x x^T would cancel against kappa vtheta vtheta^T
+  const uint32_t d = 3, N = 20;
+  const double offset = 1e6;
+  colvec vtheta0 = offset*ones<colvec>(d);
+  mat Delta0 = eye<mat>(d,d);
+  NIW niw(vtheta0,1.0,Delta0,5.0);
+  mat X = randn<mat>(d,N) + offset;
+  colvec x_q = randn<colvec>(d) + offset;
+
+  NIWPosteriorStats* ss = static_cast<NIWPosteriorStats*>(niw.newStats());
+  for (uint32_t i=0; i<N; ++i)
+    ss->add(X.col(i)); // rank-one updates
+  BOOST_CHECK_SMALL( niw.predictiveProb(x_q,*ss) - niwPredictive(x_q,X,vtheta0,1.0,Delta0,5.0), 1e-8 );
+
+  // remove the points 5..14 in an interleaved order (rank-one downdates)
+  for (uint32_t i=5; i<15; i+=2)
+    ss->remove(X.col(i));
+  for (uint32_t i=6; i<15; i+=2)
+    ss->remove(X.col(i));
+  mat Xr = join_rows(X.cols(0,4),X.cols(15,N-1));
+  double p = niwPredictive(x_q,Xr,vtheta0,1.0,Delta0,5.0);
+  BOOST_CHECK_SMALL( niw.predictiveProb(x_q,*ss) - p, 1e-8 );
+
+  // freshly built statistics and the predictive from the points
+  NIWPosteriorStats ssFresh(niw);
+  ssFresh.addBatch(Xr,ones<colvec>(Xr.n_cols));
+  BOOST_CHECK_SMALL( niw.predictiveProb(x_q,ssFresh) - p, 1e-8 );
+  BOOST_CHECK_SMALL( niw.predictiveProb(x_q,Xr) - p, 1e-8 );
+  BOOST_CHECK_SMALL( ss->mN - ssFresh.mN, 1e-12 );
+  BOOST_CHECK_SMALL( max(abs(ss->mMean - ssFresh.mMean)), 1e-6 );
+  BOOST_CHECK_SMALL( max(max(abs(ss->mScatter - ssFresh.mScatter))), 1e-6 );
+
+  // removing all points gives back the prior predictive
+  for (uint32_t i=0; i<Xr.n_cols; ++i)
+    ss->remove(Xr.col(i));
+  BOOST_CHECK_EQUAL( ss->mN, 0.0 );
+  BOOST_CHECK_SMALL( niw.predictiveProb(x_q,*ss) - niw.predictiveProb(x_q), 1e-10 );
+  BOOST_CHECK_SMALL( niw.predictiveProb(x_q) - niwPredictive(x_q,mat(d,0),vtheta0,1.0,Delta0,5.0), 1e-10 );
+  delete ss;
+}
+
+// log of a Student-t with nu degrees of freedom, location mu and scale sigma
+double logStudentT1(double x, double nu, double mu, double sigma)
+{
+  double z = (x-mu)/sigma;
+  return boost::math::lgamma(0.5*(nu+1.0)) - boost::math::lgamma(0.5*nu) 
+    - 0.5*log(nu*datum::pi) - log(sigma) - 0.5*(nu+1.0)*log(1.0+z*z/nu);
+}
+
+NormalGamma normalGammaPrior(uint32_t d)
+{
+  colvec vmu = randn<colvec>(d);
+  colvec beta = 0.5 + randu<colvec>(d);
+  return NormalGamma(vmu,2.0,3.0,beta);
+}
+
+BOOST_AUTO_TEST_CASE( normalGammaElogTest )
+{
+  const uint32_t d = 4;
+  NormalGamma ng = normalGammaPrior(d);
+  mat X = randn<mat>(d,10);
+  Row<double> eLog;
+  ng.ElogBatch(X,eLog);
+  BOOST_CHECK_EQUAL( eLog.n_elem, X.n_cols );
+  for (uint32_t i=0; i<X.n_cols; ++i)
+    BOOST_CHECK_SMALL( eLog(i) - ng.Elog(X.col(i)), 1e-10 );
+}
+
+BOOST_AUTO_TEST_CASE( normalGammaPredictiveTest )
+{
+  // product of d Student-t with 2 alpha dof, mean mu and sigma_j^2 = beta_j (kappa+1)/(alpha kappa)
+  const uint32_t d = 4;
+  NormalGamma ng = normalGammaPrior(d);
+  colvec x = randn<colvec>(d);
+  double p = 0.0;
+  for (uint32_t j=0; j<d; ++j)
+    p += logStudentT1(x(j), 2.0*ng.mAlpha, ng.mVmu(j), 
+        sqrt(ng.mBeta(j)*(ng.mKappa+1.0)/(ng.mAlpha*ng.mKappa)));
+  BOOST_CHECK_SMALL( ng.predictiveProb(x) - p, 1e-10 );
+}
+
+BOOST_AUTO_TEST_CASE( normalGammaPosteriorTest )
+{
+  const uint32_t d = 4;
+  NormalGamma ng = normalGammaPrior(d);
+  mat X = randn<mat>(d,15) + 3.0;
+  colvec x = randn<colvec>(d);
+
+  // posterior from the points and from their statistics
+  NormalGamma ngX(ng), ngSs(ng);
+  ngX.posterior(X);
+  SuffStats<double>* ss = ng.newStats();
+  for (uint32_t i=0; i<X.n_cols; ++i)
+    ss->add(X.col(i));
+  ngSs.posterior(*ss);
+  BOOST_CHECK_SMALL( max(abs(ngX.asRow() - ngSs.asRow())), 1e-9 );
+  BOOST_CHECK_SMALL( ngX.predictiveProb(x) - ngSs.predictiveProb(x), 1e-10 );
+
+  // predictive given the points and given their statistics
+  BOOST_CHECK_SMALL( ng.predictiveProb(x,X) - ng.predictiveProb(x,*ss), 1e-10 );
+  BOOST_CHECK_SMALL( ng.predictiveProb(x,X) - ngX.predictiveProb(x), 1e-10 );
+  delete ss;
+}
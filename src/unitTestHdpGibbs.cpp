@@ -0,0 +1,193 @@
+
+
+#include <armadillo>
+
+#include "random.hpp"
+#include "baseMeasure.hpp"
+#include "hdp_gibbs.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE hdpGibbs
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace arma;
+
+// exposes the helpers of the sampler
+class HDP_gibbs_test : public HDP_gibbs<double,NIW>
+{
+public:
+  HDP_gibbs_test(const NIW& base, double alpha, double omega)
+    : HDP_gibbs<double,NIW>(base,alpha,omega)
+  { };
+
+  using HDP_gibbs<double,NIW>::logPredictive;
+};
+
+BOOST_AUTO_TEST_CASE( crfSeatingTest )
+{
+  CRFSeating crf(2);
+  uint32_t k0 = crf.openDish();
+  uint32_t k1 = crf.openDish();
+  BOOST_CHECK_EQUAL( k0, 0 );
+  BOOST_CHECK_EQUAL( k1, 1 );
+  BOOST_CHECK_EQUAL( crf.mK, 2 );
+
+  // two tables in restaurant 0 serve dish 0; one in restaurant 1 serves dish 1
+  uint32_t t0 = crf.openTable(0,k0);
+  uint32_t t1 = crf.openTable(0,k0);
+  uint32_t t2 = crf.openTable(1,k1);
+  BOOST_CHECK_EQUAL( t0, 0 );
+  BOOST_CHECK_EQUAL( t1, 1 );
+  BOOST_CHECK_EQUAL( t2, 0 );
+  BOOST_CHECK_EQUAL( crf.mT[0], 2 );
+  BOOST_CHECK_EQUAL( crf.mT[1], 1 );
+  BOOST_CHECK_EQUAL( crf.mM, 3 );
+  BOOST_CHECK_EQUAL( crf.mM_k[k0], 2 );
+  BOOST_CHECK_EQUAL( crf.mM_k[k1], 1 );
+
+  // closing a table keeps its dish while another table serves it
+  crf.closeTable(0,t0);
+  BOOST_CHECK_EQUAL( crf.mT[0], 1 );
+  BOOST_CHECK_EQUAL( crf.mM, 2 );
+  BOOST_CHECK_EQUAL( crf.mM_k[k0], 1 );
+  BOOST_CHECK_EQUAL( crf.mK, 2 );
+  BOOST_CHECK_EQUAL( crf.mFreeK.size(), 0 );
+
+  // closing the last table of dish 1 closes the dish
+  crf.closeTable(1,t2);
+  BOOST_CHECK_EQUAL( crf.mK, 1 );
+  BOOST_CHECK_EQUAL( crf.mM_k[k1], 0 );
+  BOOST_CHECK_EQUAL( crf.mFreeK.size(), 1 );
+
+  // moving the remaining table to another dish closes dish 0
+  uint32_t k2 = crf.openDish();
+  BOOST_CHECK_EQUAL( k2, k1 ); // the free slot is reused
+  crf.unserve(0,t1);
+  crf.serve(0,t1,k2);
+  BOOST_CHECK_EQUAL( crf.mK, 1 );
+  BOOST_CHECK_EQUAL( crf.mM_k[k0], 0 );
+  BOOST_CHECK_EQUAL( crf.mM_k[k2], 1 );
+  BOOST_CHECK_EQUAL( crf.mK_jt[0][t1], k2 );
+
+  // free table slots are reused with no customers; the others are untouched
+  crf.mN_jt[0][t1] = 3;
+  uint32_t t3 = crf.openTable(0,k2);
+  BOOST_CHECK_EQUAL( t3, t0 );
+  BOOST_CHECK_EQUAL( crf.mN_jt[0][t3], 0 );
+  BOOST_CHECK_EQUAL( crf.mN_jt[0][t1], 3 );
+  BOOST_CHECK_EQUAL( crf.slotsT(0), 2 );
+  BOOST_CHECK_EQUAL( crf.mM_k[k2], 2 );
+
+  // no free slot left -> new ones
+  BOOST_CHECK_EQUAL( crf.openTable(0,k2), 2 );
+  BOOST_CHECK_EQUAL( crf.slotsT(0), 3 );
+  BOOST_CHECK_EQUAL( crf.openDish(), k0 );
+  BOOST_CHECK_EQUAL( crf.openDish(), 2 );
+  BOOST_CHECK_EQUAL( crf.slotsK(), 3 );
+  BOOST_CHECK_EQUAL( crf.mK, 3 );
+}
+
+const uint32_t J = 6, N = 30;
+
+// J docs of N points from two well separated Gaussians; c: generating cluster
+void sampleTwoClusters(vector<Mat<double> >& x, vector<Row<uint32_t> >& c)
+{
+  srand(1);
+  x.resize(J);
+  c.resize(J);
+  for (uint32_t j=0; j<J; ++j)
+  {
+    x[j] = 0.5*randn<Mat<double> >(2,N);
+    c[j].set_size(N);
+    for (uint32_t i=0; i<N; ++i)
+    {
+      c[j](i) = rand()%2;
+      x[j].col(i) += c[j](i)==0 ? -5.0 : 5.0;
+    }
+  }
+}
+
+NIW twoClusterPrior()
+{
+  colvec vtheta(2);
+  vtheta.zeros();
+  mat Delta = 0.5*eye<mat>(2,2); // E[Sigma] = Delta/(nu-d-1) = 0.25 I
+  return NIW(vtheta,0.1,Delta,5.0);
+}
+
+BOOST_AUTO_TEST_CASE( twoClusterTest )
+{
+  // the sampler has to find two dishes and label the points like the
+  // generating clusters
+  vector<Mat<double> > x;
+  vector<Row<uint32_t> > c;
+  sampleTwoClusters(x,c);
+  NIW niw = twoClusterPrior();
+  HDP_gibbs<double,NIW> hdp(niw,1.0,1.0);
+  hdp.setSeed(1);
+  vector<Row<uint32_t> > z = hdp.densityEst(x,0,2,4,30);
+
+  uint32_t K = 0; // labels are 0..K-1
+  for (uint32_t j=0; j<J; ++j)
+    K = max(K,z[j].max()+1);
+  BOOST_CHECK_EQUAL( K, 2 );
+  uint32_t perm = z[0](0) == c[0](0) ? 0 : 1; // labels are unique up to a permutation
+  uint32_t wrong = 0;
+  for (uint32_t j=0; j<J; ++j)
+    for (uint32_t i=0; i<N; ++i)
+      if (z[j](i) != (c[j](i)+perm)%2)
+        ++wrong;
+  BOOST_CHECK_EQUAL( wrong, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( logPredictiveTest )
+{
+  // the table step scores the customers of a table by their joint sequential
+  // predictive under the statistics of a dish; these must be unchanged afterwards
+  vector<Mat<double> > x;
+  vector<Row<uint32_t> > c;
+  sampleTwoClusters(x,c);
+  NIW niw = twoClusterPrior();
+  HDP_gibbs_test hdp(niw,1.0,1.0);
+
+  vector<uint32_t> ids; // customers of a table in doc 0
+  ids.push_back(3);
+  ids.push_back(7);
+  ids.push_back(1);
+  ids.push_back(12);
+  Mat<double> X0 = x[1].cols(0,9); // customers of the dish at other tables
+
+  NIWPosteriorStats* ss = static_cast<NIWPosteriorStats*>(niw.newStats());
+  for (uint32_t i=0; i<X0.n_cols; ++i)
+    ss->add(X0.col(i));
+  NIWPosteriorStats ss0(*ss);
+  double p0 = niw.predictiveProb(x[0].col(0),*ss);
+
+  // product of the predictives of each customer given the dish and the customers before it
+  double f = 0.0, fNew = 0.0;
+  Mat<double> given(X0), givenNew(2,0);
+  for (uint32_t i=0; i<ids.size(); ++i)
+  {
+    f += niw.predictiveProb(x[0].col(ids[i]),given);
+    fNew += niw.predictiveProb(x[0].col(ids[i]),givenNew);
+    given = join_rows(given,x[0].col(ids[i]));
+    givenNew = join_rows(givenNew,x[0].col(ids[i]));
+  }
+  BOOST_CHECK_SMALL( hdp.logPredictive(x[0],ids,*ss) - f, 1e-8 );
+
+  // add/remove round trip gives back the statistics and the predictive
+  BOOST_CHECK_EQUAL( ss->mN, ss0.mN );
+  BOOST_CHECK_SMALL( max(abs(ss->mMean - ss0.mMean)), 1e-10 );
+  BOOST_CHECK_SMALL( max(max(abs(ss->mScatter - ss0.mScatter))), 1e-10 );
+  BOOST_CHECK_SMALL( ss->mKappa - ss0.mKappa, 1e-12 );
+  BOOST_CHECK_SMALL( max(abs(ss->mVtheta - ss0.mVtheta)), 1e-10 );
+  BOOST_CHECK_SMALL( niw.predictiveProb(x[0].col(0),*ss) - p0, 1e-8 );
+  delete ss;
+
+  // a new dish starts from the prior and is empty again afterwards
+  NIWPosteriorStats ssNew(niw);
+  BOOST_CHECK_SMALL( hdp.logPredictive(x[0],ids,ssNew) - fNew, 1e-8 );
+  BOOST_CHECK_EQUAL( ssNew.mN, 0.0 );
+  BOOST_CHECK_SMALL( niw.predictiveProb(x[0].col(0),ssNew) - niw.predictiveProb(x[0].col(0)), 1e-10 );
+}
@@ -0,0 +1,226 @@
+
+
+#include <armadillo>
+
+#include "random.hpp"
+#include "baseMeasure.hpp"
+#include "hdp_gibbs_da.hpp"
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE hdpGibbsDa
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace arma;
+
+// exposes the dish bookkeeping of the sampler
+class HDP_gibbs_da_test : public HDP_gibbs_da<uint32_t,Dir>
+{
+public:
+  HDP_gibbs_da_test(const Dir& base, double alpha, double omega)
+    : HDP_gibbs_da<uint32_t,Dir>(base,alpha,omega)
+  { };
+
+  using HDP_gibbs_da<uint32_t,Dir>::openDish;
+};
+
+BOOST_AUTO_TEST_CASE( sampleTablesTest )
+{
+  // E[m] = sum_{l<n} ab/(ab+l) tables for n customers
+  RandDisc rndDisc(1);
+  double ab[] = {0.5, 2.0};
+  uint32_t n[] = {1, 5, 20};
+  const uint32_t R = 20000;
+  for (uint32_t i=0; i<2; ++i)
+    for (uint32_t j=0; j<3; ++j)
+    {
+      double Em = 0.0;
+      for (uint32_t l=0; l<n[j]; ++l)
+        Em += ab[i]/(ab[i]+l);
+      double m = 0.0;
+      for (uint32_t r=0; r<R; ++r)
+      {
+        uint32_t m_r = sampleTables(rndDisc,ab[i],n[j]);
+        BOOST_CHECK( m_r >= 1 && m_r <= n[j] );
+        m += m_r;
+      }
+      BOOST_CHECK_SMALL( m/R - Em, 0.05 );
+    }
+  BOOST_CHECK_EQUAL( sampleTables(rndDisc,1.0,0), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( sampleDiscLogProbTest )
+{
+  // log probabilities far from 0 must neither overflow nor underflow; NaN -> never drawn
+  RandDisc rndDisc(1);
+  colvec l(4);
+  l << 1000.0+log(0.2) << math::nan() << 1000.0+log(0.8) << -datum::inf;
+  const uint32_t R = 20000;
+  Col<double> freq(4);
+  freq.zeros();
+  for (uint32_t r=0; r<R; ++r)
+    freq(sampleDiscLogProb(rndDisc,l)) += 1.0;
+  BOOST_CHECK_EQUAL( freq(1), 0.0 );
+  BOOST_CHECK_EQUAL( freq(3), 0.0 );
+  BOOST_CHECK_SMALL( freq(0)/R - 0.2, 0.01 );
+
+  l << -1000.0+log(0.2) << -1000.0+log(0.8) << math::nan() << math::nan();
+  freq.zeros();
+  for (uint32_t r=0; r<R; ++r)
+    freq(sampleDiscLogProb(rndDisc,l)) += 1.0;
+  BOOST_CHECK_SMALL( freq(0)/R - 0.2, 0.01 );
+  BOOST_CHECK_EQUAL( freq(0)+freq(1), double(R) );
+}
+
+BOOST_AUTO_TEST_CASE( dirRndTest )
+{
+  // entries with alpha = 0 are exactly 0; the others have mean alpha/sum(alpha)
+  Row<double> alpha(5);
+  alpha << 0.0 << 2.0 << 0.0 << 1.0 << 0.5;
+  DirRnd rndDir(1);
+  Row<double> pi, mean(5);
+  mean.zeros();
+  const uint32_t R = 10000;
+  for (uint32_t r=0; r<R; ++r)
+  {
+    rndDir.draw(pi,alpha);
+    BOOST_CHECK_EQUAL( pi(0), 0.0 );
+    BOOST_CHECK_EQUAL( pi(2), 0.0 );
+    BOOST_CHECK_SMALL( sum(pi) - 1.0, 1e-12 );
+    mean += pi;
+  }
+  mean /= R;
+  for (uint32_t i=0; i<5; ++i)
+    BOOST_CHECK_SMALL( mean(i) - alpha(i)/3.5, 0.01 );
+
+  // same seed -> same stream; distinct seeds -> distinct streams
+  DirRnd rndA(7), rndB(7), rndC(8);
+  Row<double> piA, piB, piC;
+  rndA.draw(piA,alpha);
+  rndB.draw(piB,alpha);
+  rndC.draw(piC,alpha);
+  BOOST_CHECK_EQUAL( accu(piA != piB), 0 );
+  BOOST_CHECK( accu(piA != piC) > 0 );
+}
+
+BOOST_AUTO_TEST_CASE( openDishTest )
+{
+  Row<double> eta(5);
+  eta.fill(0.5);
+  Dir dir(eta);
+  HDP_gibbs_da_test hdp(dir,1.0,1.0);
+
+  uint32_t K = 0;
+  vector<uint32_t> n_k, freeK;
+  Mat<uint32_t> n_jk(2,0);
+  Row<double> beta;
+  StatsContainer<uint32_t> ss_k;
+  BOOST_CHECK_EQUAL( hdp.openDish(K,n_k,freeK,n_jk,beta,ss_k), 0 );
+  BOOST_CHECK_EQUAL( hdp.openDish(K,n_k,freeK,n_jk,beta,ss_k), 1 );
+  BOOST_CHECK_EQUAL( K, 2 );
+  BOOST_CHECK_EQUAL( n_jk.n_cols, 2 );
+  BOOST_CHECK_EQUAL( accu(n_jk), 0 );
+
+  // seat two customers eating word 3 at dish 0, then close it with leftover statistics
+  Col<uint32_t> w(1);
+  w(0) = 3;
+  ss_k[0]->add(w);
+  ss_k[0]->add(w);
+  n_k[0] = 2;
+  n_jk(0,0) = 2;
+  beta(0) = 0.4;
+  ss_k[0]->remove(w);
+  n_k[0] = 0;
+  n_jk(0,0) = 0;
+  freeK.push_back(0);
+  K--;
+
+  // the free slot is reused with empty statistics and zero weight
+  BOOST_CHECK_EQUAL( hdp.openDish(K,n_k,freeK,n_jk,beta,ss_k), 0 );
+  BOOST_CHECK_EQUAL( K, 2 );
+  BOOST_CHECK_EQUAL( freeK.size(), 0 );
+  BOOST_CHECK_EQUAL( n_k.size(), 2 );
+  BOOST_CHECK_EQUAL( n_jk.n_cols, 2 );
+  BOOST_CHECK_EQUAL( beta.n_elem, 2 );
+  BOOST_CHECK_EQUAL( beta(0), 0.0 );
+  BOOST_CHECK_EQUAL( ss_k[0]->mN, 0.0 );
+  BOOST_CHECK_SMALL( dir.predictiveProb(w,*ss_k[0]) - dir.predictiveProb(w), 1e-12 );
+
+  // no free slot left -> a new one
+  BOOST_CHECK_EQUAL( hdp.openDish(K,n_k,freeK,n_jk,beta,ss_k), 2 );
+  BOOST_CHECK_EQUAL( K, 3 );
+  BOOST_CHECK_EQUAL( n_jk.n_cols, 3 );
+  BOOST_CHECK_EQUAL( ss_k.size(), 3 );
+}
+
+const uint32_t J = 6, N = 30;
+
+// J docs of N points from two well separated Gaussians; c: generating cluster
+void sampleTwoClusters(vector<Mat<double> >& x, vector<Row<uint32_t> >& c)
+{
+  srand(1);
+  x.resize(J);
+  c.resize(J);
+  for (uint32_t j=0; j<J; ++j)
+  {
+    x[j] = 0.5*randn<Mat<double> >(2,N);
+    c[j].set_size(N);
+    for (uint32_t i=0; i<N; ++i)
+    {
+      c[j](i) = rand()%2;
+      x[j].col(i) += c[j](i)==0 ? -5.0 : 5.0;
+    }
+  }
+}
+
+NIW twoClusterPrior()
+{
+  colvec vtheta(2);
+  vtheta.zeros();
+  mat Delta = 0.5*eye<mat>(2,2); // E[Sigma] = Delta/(nu-d-1) = 0.25 I
+  return NIW(vtheta,0.1,Delta,5.0);
+}
+
+BOOST_AUTO_TEST_CASE( twoClusterTest )
+{
+  // the sampler has to find two dishes and label the points like the 
+  // generating clusters
+  vector<Mat<double> > x;
+  vector<Row<uint32_t> > c;
+  sampleTwoClusters(x,c);
+  NIW niw = twoClusterPrior();
+  HDP_gibbs_da<double,NIW> hdp(niw,1.0,1.0);
+  hdp.setSeed(1);
+  vector<Row<uint32_t> > z = hdp.densityEst(x,0,1,30);
+
+  BOOST_CHECK_EQUAL( hdp.getWeights().n_elem, 2 );
+  uint32_t perm = z[0](0) == c[0](0) ? 0 : 1; // labels are unique up to a permutation
+  uint32_t wrong = 0;
+  for (uint32_t j=0; j<J; ++j)
+    for (uint32_t i=0; i<N; ++i)
+      if (z[j](i) != (c[j](i)+perm)%2)
+        ++wrong;
+  BOOST_CHECK_EQUAL( wrong, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( staticDispatchTest )
+{
+  // H=NIW calls the same code as the virtual dispatch -> same draws for the same seed
+  vector<Mat<double> > x;
+  vector<Row<uint32_t> > c;
+  sampleTwoClusters(x,c);
+  NIW niw = twoClusterPrior();
+  HDP_gibbs_da<double> hdpVirt(niw,1.0,1.0);
+  HDP_gibbs_da<double,NIW> hdpStat(niw,1.0,1.0);
+  hdpVirt.setSeed(3);
+  hdpStat.setSeed(3);
+
+  vector<Row<uint32_t> > zVirt = hdpVirt.densityEst(x,0,4,30);
+  vector<Row<uint32_t> > zStat = hdpStat.densityEst(x,0,4,30);
+
+  for (uint32_t j=0; j<J; ++j)
+    BOOST_CHECK_EQUAL( accu(zVirt[j] != zStat[j]), 0 );
+  BOOST_CHECK_EQUAL( hdpVirt.getWeights().n_elem, hdpStat.getWeights().n_elem );
+  if (hdpVirt.getWeights().n_elem == hdpStat.getWeights().n_elem)
+    BOOST_CHECK_SMALL( max(abs(hdpVirt.getWeights() - hdpStat.getWeights())), 1e-12 );
+}
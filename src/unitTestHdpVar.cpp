@@ -0,0 +1,159 @@
+
+
+#include <armadillo>
+
+#include "hdp_var.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE hdpVar
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace arma;
+
+const uint32_t Nw = 40;
+const uint32_t Ktrue = 4;
+
+// D docs of N words; each doc is drawn from one of Ktrue topics over disjoint blocks of words
+void sampleCorpus(vector<Mat<uint32_t> >& x, uint32_t D, uint32_t N)
+{
+  x.resize(D);
+  for (uint32_t d=0; d<D; ++d)
+  {
+    uint32_t w0 = (d%Ktrue)*(Nw/Ktrue);
+    x[d].set_size(1,N);
+    for (uint32_t n=0; n<N; ++n)
+      x[d](0,n) = w0 + rand()%(Nw/Ktrue);
+  }
+}
+
+double heldOutPerplexity(HDP_var<uint32_t>& hdp, uint32_t D)
+{
+  vector<Mat<uint32_t> > x_eval;
+  sampleCorpus(x_eval,8,40);
+  double perp = 0.0;
+  for (uint32_t i=0; i<x_eval.size(); ++i)
+    perp += hdp.perplexity(x_eval[i].cols(0,9),x_eval[i].cols(10,39),D,0.9);
+  return perp/double(x_eval.size());
+}
+
+BOOST_AUTO_TEST_CASE( densityEstDistributedTest )
+{
+  // the workers are forked after OpenMP and the BLAS have been used by this
+  // process; with live thread pools in the parent they must neither hang nor
+  // crash, and the model of P workers has to fit the corpus like one worker
+  srand(0);
+  vector<Mat<uint32_t> > x;
+  sampleCorpus(x,200,50);
+  Row<double> alphas(Nw);
+  alphas.fill(0.1);
+  Dir dir(alphas);
+
+  HDP_var<uint32_t> hdpHog(dir, 1.0, 10.0);
+  hdpHog.setHogwild(true); // starts the OpenMP thread pool
+  hdpHog.densityEst(x,Nw,0.9,10,5,10);
+  Mat<double> A = randu<Mat<double> >(200,200);
+  Mat<double> B = A*A; // and the one of a threaded BLAS
+  BOOST_CHECK( is_finite(B) );
+
+  uint32_t P[] = {1,4};
+  for (uint32_t i=0; i<2; ++i)
+  {
+    HDP_var<uint32_t> hdp(dir, 1.0, 10.0);
+    BOOST_CHECK( hdp.densityEstDistributed(x,Nw,0.9,10,5,10,P[i]) );
+    Mat<double> topics;
+    hdp.getCorpTopics(topics);
+    BOOST_CHECK( is_finite(topics) );
+    double perp = heldOutPerplexity(hdp,x.size());
+    cout<<"P="<<P[i]<<" held out perplexity="<<perp<<endl;
+    // a uniform model has perplexity Nw; the true one Nw/Ktrue
+    BOOST_CHECK( is_finite(perp) );
+    BOOST_CHECK( perp < 0.75*Nw );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( staticDispatchDirTest )
+{
+  // the sparse minibatch updates of Dir go through the DirTopicBank for either
+  // H; the doc level updates of perplexity() evaluate E[log beta] and the doc
+  // mixture through Measure<uint32_t,Dir>. The docs are read in order so that
+  // both models see the same minibatches.
+  srand(0);
+  vector<Mat<uint32_t> > x, x_eval;
+  sampleCorpus(x,120,50);
+  sampleCorpus(x_eval,8,40);
+  Row<double> alphas(Nw);
+  alphas.fill(0.1);
+  Dir dir(alphas);
+  HDP_var<uint32_t> hdpVirt(dir, 1.0, 10.0);
+  HDP_var<uint32_t,double,Dir> hdpStat(dir, 1.0, 10.0);
+
+  VectorCorpusReader<uint32_t> readerVirt(x);
+  srand(1);
+  BOOST_CHECK( hdpVirt.densityEst(readerVirt,Nw,0.9,10,5,20) );
+  VectorCorpusReader<uint32_t> readerStat(x);
+  srand(1);
+  BOOST_CHECK( hdpStat.densityEst(readerStat,Nw,0.9,10,5,20) );
+
+  for (uint32_t i=0; i<x_eval.size(); ++i)
+  {
+    double perpVirt = hdpVirt.perplexity(x_eval[i].cols(0,9),x_eval[i].cols(10,39),x.size(),0.9);
+    double perpStat = hdpStat.perplexity(x_eval[i].cols(0,9),x_eval[i].cols(10,39),x.size(),0.9);
+    BOOST_CHECK( is_finite(perpVirt) );
+    BOOST_CHECK_SMALL( (perpVirt - perpStat)/perpVirt, 1e-9 );
+  }
+}
+
+// D docs of N points in 2D; each doc is drawn from one of Ktrue well separated Gaussians
+void sampleGaussCorpus(vector<Mat<double> >& x, uint32_t D, uint32_t N)
+{
+  x.resize(D);
+  for (uint32_t d=0; d<D; ++d)
+  {
+    x[d] = 0.5*randn<Mat<double> >(2,N);
+    x[d].row(d%2) += 5.0*double(d%Ktrue) - 7.5;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( staticDispatchNormalGammaTest )
+{
+  // NormalGamma has no E[log beta] table -> the minibatch updates evaluate
+  // E[log beta] through Measure<double,NormalGamma>::ElogBatch for every doc
+  srand(0);
+  vector<Mat<double> > x, x_eval;
+  sampleGaussCorpus(x,80,30);
+  sampleGaussCorpus(x_eval,4,40);
+  colvec vmu = zeros<colvec>(2);
+  colvec beta = 0.5*ones<colvec>(2);
+  NormalGamma ng(vmu,0.1,2.0,beta);
+  HDP_var<double> hdpVirt(ng, 1.0, 10.0);
+  HDP_var<double,double,NormalGamma> hdpStat(ng, 1.0, 10.0);
+
+  VectorCorpusReader<double> readerVirt(x);
+  srand(1);
+  BOOST_CHECK( hdpVirt.densityEst(readerVirt,1,0.9,8,4,20) );
+  VectorCorpusReader<double> readerStat(x);
+  srand(1);
+  BOOST_CHECK( hdpStat.densityEst(readerStat,1,0.9,8,4,20) );
+
+  Mat<double> topicsVirt, topicsStat, aVirt, aStat;
+  hdpVirt.getCorpTopics(topicsVirt);
+  hdpStat.getCorpTopics(topicsStat);
+  hdpVirt.getA(aVirt);
+  hdpStat.getA(aStat);
+  BOOST_CHECK( is_finite(topicsVirt) );
+  BOOST_CHECK_SMALL( max(max(abs(topicsVirt - topicsStat)/(abs(topicsVirt)+1.0))), 1e-9 );
+  BOOST_CHECK_SMALL( max(max(abs(aVirt - aStat)/aVirt)), 1e-9 );
+
+  for (uint32_t i=0; i<x_eval.size(); ++i)
+  {
+    double perpVirt = hdpVirt.perplexity(x_eval[i].cols(0,9),x_eval[i].cols(10,39),x.size(),0.9);
+    double perpStat = hdpStat.perplexity(x_eval[i].cols(0,9),x_eval[i].cols(10,39),x.size(),0.9);
+    BOOST_CHECK( is_finite(perpVirt) );
+    BOOST_CHECK_SMALL( (perpVirt - perpStat)/perpVirt, 1e-9 );
+  }
+}
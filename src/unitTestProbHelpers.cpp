@@ -40,3 +40,43 @@ BOOST_AUTO_TEST_CASE( probabilityHelpersTest )
 
 
 }
+
+BOOST_AUTO_TEST_CASE( normalizeLogDistributionRowsTest )
+{
+  Mat<double> r(3,4);
+  r << 0.0 << 0.0 << 0.0 << 0.0 << endr
+    << log(1.0) << log(2.0) << log(3.0) << log(4.0) << endr
+    << -1000.0 << -1001.0 << -2000.0 << -1000.0 << endr;
+  normalizeLogDistributionRows(r);
+
+  BOOST_CHECK_SMALL( r(0,0) - 0.25, 1e-12 );
+  BOOST_CHECK_SMALL( r(1,3) - 0.4, 1e-12 );
+  BOOST_CHECK_SMALL( r(2,2), 1e-12 ); // no underflow to nan for very small log probabilities
+  BOOST_CHECK_SMALL( r(2,0) - r(2,3), 1e-12 );
+  for (uint32_t n=0; n<r.n_rows; ++n)
+    BOOST_CHECK_SMALL( sum(r.row(n)) - 1.0, 1e-12 ); 
+}
+
+BOOST_AUTO_TEST_CASE( cholUpdateTest )
+{
+  Mat<double> A(3,3);
+  A << 4.0 << 2.0 << 0.4 << endr
+    << 2.0 << 5.0 << 1.0 << endr
+    << 0.4 << 1.0 << 3.0 << endr;
+  Col<double> x(3);
+  x << 0.5 << -1.0 << 2.0;
+  Mat<double> L0 = trans(chol(A));
+
+  Mat<double> L = L0;
+  BOOST_CHECK( cholUpdate(L,x,1.0) );
+  BOOST_CHECK_SMALL( max(max(abs(L*L.t() - (A + x*x.t())))), 1e-12 );
+  BOOST_CHECK_SMALL( max(max(abs(L - trans(chol(A + x*x.t()))))), 1e-12 );
+
+  // downdate back to the factor of A
+  BOOST_CHECK( cholUpdate(L,x,-1.0) );
+  BOOST_CHECK_SMALL( max(max(abs(L - L0))), 1e-12 );
+
+  // downdate that leaves A indefinite
+  L = L0;
+  BOOST_CHECK( !cholUpdate(L,3.0*x,-1.0) );
+}
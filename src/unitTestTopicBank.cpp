@@ -0,0 +1,97 @@
+
+
+#include <armadillo>
+
+#include "topicBank.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE topicBank
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace arma;
+
+const uint32_t K = 4;
+const uint32_t Nw = 50;
+
+void initBank(DirTopicBank& bank)
+{
+  Row<double> eta(Nw);
+  eta.fill(0.1);
+  Dir dir(eta);
+  DistriContainer<uint32_t> lambda(dir,K);
+  bank.init(lambda,eta);
+}
+
+BOOST_AUTO_TEST_CASE( updateHogwildSerialTest )
+{
+  // on one thread updateHogwild() has to match update(); ro close to 1 folds the scales every few updates
+  DirTopicBank bank, bankHog;
+  initBank(bank);
+  initBank(bankHog);
+  Col<uint32_t> words(3);
+  words << 2 << 7 << 31;
+  Mat<double> dM = randu<Mat<double> >(K,words.n_elem);
+  for (uint32_t i=0; i<500; ++i)
+  {
+    bank.update(words,(i%7+1.0)*dM,0.99);
+    bankHog.updateHogwild(words,(i%7+1.0)*dM,0.99);
+  }
+  for (uint32_t k=0; k<K; ++k)
+  {
+    BOOST_CHECK_SMALL( bankHog.alpha0(k) - bank.alpha0(k), 1e-9 );
+    for (uint32_t w=0; w<Nw; ++w)
+      BOOST_CHECK_SMALL( bankHog.alpha(k,w) - bank.alpha(k,w), 1e-9 );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( updateHogwildFoldTest )
+{
+  // many threads with ro close to 1 fold the scales every 50 updates; no
+  // update may land in a folded row with the scale from before the fold
+  uint32_t P = 1;
+#ifdef _OPENMP
+  P = max(omp_get_max_threads(),8);
+  omp_set_num_threads(P);
+#endif
+  DirTopicBank bank, bankHog;
+  initBank(bank);
+  initBank(bankHog);
+  Col<uint32_t> words(10);
+  for (uint32_t j=0; j<words.n_elem; ++j)
+    words(j) = 3*j;
+  Mat<double> dM(K,words.n_elem);
+  dM.fill(2.0);
+  const uint32_t Nu = 20000;
+  for (uint32_t i=0; i<Nu; ++i)
+    bank.update(words,dM,0.99);
+#pragma omp parallel for schedule(dynamic)
+  for (uint32_t i=0; i<Nu; ++i)
+  {
+    Mat<double> tab;
+    bankHog.ElogTable(words,tab); // concurrent reads
+    bankHog.updateHogwild(words,dM,0.99);
+  }
+
+  for (uint32_t k=0; k<K; ++k)
+  {
+    double alpha0 = 0.0;
+    for (uint32_t w=0; w<Nw; ++w)
+    {
+      double a = bankHog.alpha(k,w);
+      alpha0 += a;
+      BOOST_CHECK( is_finite(a) );
+      if (w%3 == 0 && w/3 < words.n_elem)
+      { // serial: eta + dM; interleaved updates can at most add the P in flight
+        BOOST_CHECK_SMALL( bank.alpha(k,w) - 2.1, 1e-9 );
+        BOOST_CHECK( a >= 0.1 && a <= 0.1 + P*2.0 + 1e-9 );
+      }else
+        BOOST_CHECK_SMALL( a - 0.1, 1e-12 ); // never touched
+    }
+    BOOST_CHECK_SMALL( bankHog.alpha0(k) - alpha0, 1e-6*alpha0 );
+  }
+}